@@ -0,0 +1,87 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "rtweekend.h"
+
+#include <utility>  // For std::swap in the slab test.
+
+/*
+ * Axis-aligned bounding box.
+ * Stored as one interval per axis so box unions and slab tests reuse interval logic; the basic building block of every
+ * acceleration structure.
+ */
+class aabb {
+public:
+    interval x, y, z;
+
+    // Default box is empty, since intervals are empty by default.
+    aabb() {}
+
+    aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z) {}
+
+    // Treat the two points a and b as extrema for the bounding box, so no particular min/max ordering is required.
+    aabb(const point3& a, const point3& b) {
+        x = (a.x() <= b.x()) ? interval(a.x(), b.x()) : interval(b.x(), a.x());
+        y = (a.y() <= b.y()) ? interval(a.y(), b.y()) : interval(b.y(), a.y());
+        z = (a.z() <= b.z()) ? interval(a.z(), b.z()) : interval(b.z(), a.z());
+    }
+
+    aabb(const aabb& box0, const aabb& box1) : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+    const interval& axis_interval(int n) const {
+        if (n == 1) return y;
+        if (n == 2) return z;
+        return x;
+    }
+
+    point3 centroid() const {
+        return point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+    }
+
+    // Surface area drives the SAH cost model; empty boxes report zero.
+    double surface_area() const {
+        if (x.size() < 0 || y.size() < 0 || z.size() < 0) return 0;
+        return 2 * (x.size() * y.size() + y.size() * z.size() + z.size() * x.size());
+    }
+
+    // Returns the index of the longest axis of the bounding box.
+    int longest_axis() const {
+        if (x.size() > y.size()) {
+            return x.size() > z.size() ? 0 : 2;
+        }
+        return y.size() > z.size() ? 1 : 2;
+    }
+
+    /*
+     * Slab test.
+     * Takes the reciprocal direction precomputed once per ray, since traversal tests many boxes against the same ray.
+     */
+    bool hit(const point3& origin, const vec3& inv_dir, interval ray_t) const {
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = axis_interval(axis);
+            double o = axis == 0 ? origin.x() : (axis == 1 ? origin.y() : origin.z());
+            double inv = axis == 0 ? inv_dir.x() : (axis == 1 ? inv_dir.y() : inv_dir.z());
+
+            double t0 = (ax.min - o) * inv;
+            double t1 = (ax.max - o) * inv;
+            if (t0 > t1) std::swap(t0, t1);
+
+            if (t0 > ray_t.min) ray_t.min = t0;
+            if (t1 < ray_t.max) ray_t.max = t1;
+            if (ray_t.max <= ray_t.min) return false;
+        }
+        return true;
+    }
+
+    bool hit(const ray& r, interval ray_t) const {
+        const vec3 d = r.direction();
+        return hit(r.origin(), vec3(1.0 / d.x(), 1.0 / d.y(), 1.0 / d.z()), ray_t);
+    }
+
+    static const aabb empty, universe;
+};
+
+const aabb aabb::empty    = aabb(interval::empty,    interval::empty,    interval::empty);
+const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef ACCUMULATION_BUFFER_H
+#define ACCUMULATION_BUFFER_H
+
+#include "rtweekend.h"
+#include "aligned_allocator.h"
+#include "async_writer.h"
+#include "framebuffer.h"
+#include "pixel_formats.h"
+
+#include <algorithm>  // For std::min and std::copy.
+#include <cstddef>    // For std::size_t.
+#include <cstdint>    // For sample counts and the checkpoint header.
+#include <cstring>    // For the checkpoint magic.
+#include <fstream>    // For loading checkpoints.
+#include <string>     // For checkpoint paths.
+#include <vector>     // For per-tile totals.
+
+// Channel totals and sample count of one tile; the same layout is used in checkpoints and live segments.
+struct accumulation_tile_totals {
+    double sum[3] = {0, 0, 0};
+    std::uint64_t samples = 0;
+};
+
+// Per-pixel means of a w x h tile from its float sums (rows `edge` apart) and totals, with the double correction.
+inline void resolve_accumulated_tile(const rgb32f_format::stored* src, const accumulation_tile_totals& totals, int w,
+                                     int h, int edge, color* out) {
+    double float_total[3] = {0, 0, 0};
+    for (int j = 0; j < h; j++) {
+        const std::size_t row = static_cast<std::size_t>(j) * edge;
+        for (int i = 0; i < w; i++) {
+            float_total[0] += src[row + i].r;
+            float_total[1] += src[row + i].g;
+            float_total[2] += src[row + i].b;
+        }
+    }
+
+    const double inverse_samples = totals.samples ? 1.0 / static_cast<double>(totals.samples) : 0.0;
+    double scale[3];
+    for (int c = 0; c < 3; c++) {
+        scale[c] = inverse_samples * (float_total[c] != 0 ? totals.sum[c] / float_total[c] : 1.0);
+    }
+
+    for (int j = 0; j < h; j++) {
+        const std::size_t row = static_cast<std::size_t>(j) * edge;
+        for (int i = 0; i < w; i++) {
+            out[row + i] = color(src[row + i].r * scale[0], src[row + i].g * scale[1], src[row + i].b * scale[2]);
+        }
+    }
+}
+
+/*
+ * Float accumulation buffer for progressive and distributed rendering.
+ * Per pixel it keeps only a float RGB sum, half the size of a double color; every pixel of a tile receives the same
+ * passes, so the sample count is kept per tile rather than per pixel. Float sums stop absorbing small passes once
+ * they grow (round-to-nearest drops an addend under half an ulp), so each tile also keeps its channel totals in
+ * double, and resolving scales the tile's float sums to add up to them. That makes each tile's mean exact for a few
+ * dozen bytes per tile; a single pixel still carries the rounding error of float summation over its pass count.
+ */
+class accumulation_buffer : public tile_layout {
+protected:
+    using stored = rgb32f_format::stored;
+    using tile_totals = accumulation_tile_totals;
+
+private:
+    // Checkpoint file: this header, the per-tile totals, then the float sums, in this machine's byte order.
+    struct checkpoint_header {
+        char magic[8];
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t tile_size;
+        std::uint32_t reserved;
+    };
+
+    static constexpr char checkpoint_magic[8] = {'R', 'T', 'A', 'C', 'C', 'U', 'M', '1'};
+    static constexpr std::size_t checkpoint_chunk_bytes = std::size_t(1) << 20;
+
+    aligned_vector<stored> owned_sums;
+    std::vector<tile_totals> owned_totals;
+    stored* sums;
+    tile_totals* totals;
+
+    std::size_t sum_count() const { return static_cast<std::size_t>(tile_count()) * tile_pixels(); }
+
+protected:
+    // Accumulates into zero-filled storage owned by a subclass (e.g. shared memory); null pointers fall back to
+    // private storage.
+    accumulation_buffer(int width, int height, int tile_size, stored* external_sums, tile_totals* external_totals)
+        : tile_layout(width, height, tile_size), sums(external_sums), totals(external_totals) {
+        if (!sums || !totals) {
+            owned_sums.resize(sum_count());
+            owned_totals.resize(tile_count());
+            sums = owned_sums.data();
+            totals = owned_totals.data();
+        }
+    }
+
+    // Bracket every change to tile t's sums and totals, so subclasses can publish updates.
+    virtual void begin_tile_update(int) {}
+    virtual void end_tile_update(int) {}
+
+public:
+    accumulation_buffer(int width, int height, int tile_size = 32)
+        : accumulation_buffer(width, height, tile_size, nullptr, nullptr) {}
+
+    virtual ~accumulation_buffer() = default;
+
+    accumulation_buffer(const accumulation_buffer&) = delete;
+    accumulation_buffer& operator=(const accumulation_buffer&) = delete;
+
+    // Adds per-pixel sums of `samples` more samples to tile t, tile_size apart per row. Tiles are independent, so
+    // different threads may add different tiles at once.
+    void add_tile(int t, const color* pixel_sums, std::uint64_t samples) {
+        begin_tile_update(t);
+        stored* dst = &sums[static_cast<std::size_t>(t) * tile_pixels()];
+        tile_totals& total = totals[t];
+        const int w = tile_width(t), h = tile_height(t);
+        for (int j = 0; j < h; j++) {
+            const std::size_t row = static_cast<std::size_t>(j) * tile_edge;
+            for (int i = 0; i < w; i++) {
+                const color& c = pixel_sums[row + i];
+                dst[row + i].r += static_cast<float>(c.x());
+                dst[row + i].g += static_cast<float>(c.y());
+                dst[row + i].b += static_cast<float>(c.z());
+                total.sum[0] += c.x();
+                total.sum[1] += c.y();
+                total.sum[2] += c.z();
+            }
+        }
+        total.samples += samples;
+        end_tile_update(t);
+    }
+
+    // Adds another buffer of the same layout, e.g. passes rendered on another machine.
+    bool merge(const accumulation_buffer& other) {
+        if (other.width() != width() || other.height() != height() || other.tile_size() != tile_size()) return false;
+        for (int t = 0; t < tile_count(); t++) {
+            begin_tile_update(t);
+            const std::size_t first = static_cast<std::size_t>(t) * tile_pixels();
+            for (std::size_t i = first; i < first + tile_pixels(); i++) {
+                sums[i].r += other.sums[i].r;
+                sums[i].g += other.sums[i].g;
+                sums[i].b += other.sums[i].b;
+            }
+            for (int c = 0; c < 3; c++) totals[t].sum[c] += other.totals[t].sum[c];
+            totals[t].samples += other.totals[t].samples;
+            end_tile_update(t);
+        }
+        return true;
+    }
+
+    std::uint64_t samples(int t) const { return totals[t].samples; }
+
+    // Per-pixel means of tile t into `out`, tile_size apart per row, with the tile's double correction applied.
+    void resolve_tile(int t, color* out) const {
+        resolve_accumulated_tile(&sums[static_cast<std::size_t>(t) * tile_pixels()], totals[t], tile_width(t),
+                                 tile_height(t), tile_edge, out);
+    }
+
+    // Resolves every tile into a framebuffer of the same layout, in whatever format it stores.
+    bool resolve(framebuffer& fb) const {
+        if (fb.width() != width() || fb.height() != height() || fb.tile_size() != tile_size()) return false;
+        std::vector<color> tile(tile_pixels());
+        for (int t = 0; t < tile_count(); t++) {
+            resolve_tile(t, tile.data());
+            fb.store_tile(t, tile.data());
+            fb.release_tile(t);
+        }
+        return true;
+    }
+
+    /*
+     * Queues a snapshot of the buffer on `writer`, from offset 0, followed by a sync; returns the sync's ticket. The
+     * snapshot is copied into 1 MiB chunks before save() returns, so accumulation can go on while they are written.
+     */
+    async_writer::ticket save(async_writer& writer) const {
+        checkpoint_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+        header.width = static_cast<std::uint32_t>(width());
+        header.height = static_cast<std::uint32_t>(height());
+        header.tile_size = static_cast<std::uint32_t>(tile_size());
+
+        const std::size_t totals_bytes = static_cast<std::size_t>(tile_count()) * sizeof(tile_totals);
+        std::vector<unsigned char> head(sizeof(header) + totals_bytes);
+        std::memcpy(head.data(), &header, sizeof(header));
+        std::memcpy(head.data() + sizeof(header), totals, totals_bytes);
+        writer.write(0, std::move(head));
+
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(sums);
+        const std::size_t data_bytes = sum_count() * sizeof(stored);
+        const std::uint64_t base = sizeof(header) + totals_bytes;
+        for (std::size_t at = 0; at < data_bytes; at += checkpoint_chunk_bytes) {
+            const std::size_t n = std::min(checkpoint_chunk_bytes, data_bytes - at);
+            writer.write(base + at, std::vector<unsigned char>(data + at, data + at + n));
+        }
+        return writer.sync();
+    }
+
+    // Replaces the contents with a checkpoint written by save() for the same layout; false if it does not match.
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        checkpoint_header header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+        if (std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0 ||
+            header.width != static_cast<std::uint32_t>(width()) ||
+            header.height != static_cast<std::uint32_t>(height()) ||
+            header.tile_size != static_cast<std::uint32_t>(tile_size())) {
+            return false;
+        }
+        std::vector<tile_totals> loaded_totals(tile_count());
+        aligned_vector<stored> loaded_sums(sum_count());
+        if (!in.read(reinterpret_cast<char*>(loaded_totals.data()), loaded_totals.size() * sizeof(tile_totals)) ||
+            !in.read(reinterpret_cast<char*>(loaded_sums.data()), loaded_sums.size() * sizeof(stored))) {
+            return false;
+        }
+        for (int t = 0; t < tile_count(); t++) {
+            begin_tile_update(t);
+            const std::size_t first = static_cast<std::size_t>(t) * tile_pixels();
+            std::copy(loaded_sums.begin() + first, loaded_sums.begin() + first + tile_pixels(), sums + first);
+            totals[t] = loaded_totals[t];
+            end_tile_update(t);
+        }
+        return true;
+    }
+
+    std::size_t storage_bytes() const {
+        return sum_count() * sizeof(stored) + static_cast<std::size_t>(tile_count()) * sizeof(tile_totals);
+    }
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>  // For std::size_t.
+#include <new>      // For aligned operator new/delete.
+#include <vector>   // For the aligned_vector alias.
+
+/*
+ * Cache-line aligned allocator.
+ * Keeps flat geometry and node arrays starting on a cache line so element strides map predictably onto lines and SIMD
+ * loads never straddle an allocation boundary.
+ */
+template <typename T, std::size_t Alignment = 64>
+class aligned_allocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = aligned_allocator<U, Alignment>; };
+
+    aligned_allocator() noexcept = default;
+
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U, Alignment>&) const noexcept { return true; }
+
+    template <typename U>
+    bool operator!=(const aligned_allocator<U, Alignment>&) const noexcept { return false; }
+};
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+#endif
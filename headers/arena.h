@@ -0,0 +1,120 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "rtweekend.h"
+
+#include <cstddef>      // For std::size_t and std::max_align_t.
+#include <new>          // For placement new and aligned operator new.
+#include <type_traits>  // For skipping destructor bookkeeping on trivially destructible types.
+#include <utility>      // For std::forward.
+#include <vector>       // For the block and destructor lists; both only grow during scene building.
+
+/*
+ * Monotonic scene arena.
+ * Bump-allocates primitives and materials out of large cache-line aligned blocks and frees them all at once; replaces one
+ * heap allocation plus one control block per scene object, and keeps objects built together adjacent in memory.
+ */
+class scene_arena {
+private:
+    struct block {
+        std::byte* data;
+        std::size_t size;
+    };
+
+    struct destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    static constexpr std::size_t block_alignment = 64;
+
+    std::size_t block_size;
+    std::vector<block> blocks;
+    std::vector<destructor> destructors;
+    std::size_t offset = 0;  // Bump offset into blocks.back()
+    std::size_t used = 0;    // Bytes handed out, excluding alignment padding
+
+    void add_block(std::size_t min_size) {
+        std::size_t size = min_size > block_size ? min_size : block_size;
+        auto data = static_cast<std::byte*>(::operator new(size, std::align_val_t(block_alignment)));
+        blocks.push_back({data, size});
+        offset = 0;
+    }
+
+public:
+    /*
+     * Constructor.
+     * Block size trades unused tail space against allocation count; 64 KiB holds several hundred spheres and materials.
+     */
+    explicit scene_arena(std::size_t block_size = 64 * 1024) : block_size(block_size) {}
+
+    // Objects handed out by the arena point into its blocks, so it is neither copyable nor movable.
+    scene_arena(const scene_arena&) = delete;
+    scene_arena& operator=(const scene_arena&) = delete;
+
+    ~scene_arena() { release(); }
+
+    /*
+     * Raw allocation.
+     * Alignment must be a power of two no larger than the block alignment; oversized requests get a dedicated block.
+     */
+    void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+        if (!blocks.empty()) {
+            std::size_t aligned = (offset + align - 1) & ~(align - 1);
+            if (aligned + size <= blocks.back().size) {
+                offset = aligned + size;
+                used += size;
+                return blocks.back().data + aligned;
+            }
+        }
+        add_block(size);
+        offset = size;
+        used += size;
+        return blocks.back().data;
+    }
+
+    /*
+     * Object construction.
+     * Returns a non-owning shared_ptr (aliasing constructor over an empty owner): it has no control block, so it plugs into
+     * the existing shared_ptr-based sphere/hittable_list/hit_record interfaces while copies never touch a reference count.
+     * The arena must outlive every pointer it hands out.
+     */
+    template <typename T, typename... Args>
+    shared_ptr<T> make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.push_back({object, [](void* p) { static_cast<T*>(p)->~T(); }});
+        }
+        return shared_ptr<T>(shared_ptr<void>(), object);
+    }
+
+    // Destroys all objects in reverse construction order and returns every block to the heap.
+    void release() {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+            it->destroy(it->object);
+        }
+        destructors.clear();
+        for (const auto& b : blocks) {
+            ::operator delete(b.data, std::align_val_t(block_alignment));
+        }
+        blocks.clear();
+        offset = 0;
+        used = 0;
+    }
+
+    std::size_t bytes_used() const { return used; }
+    std::size_t block_count() const { return blocks.size(); }
+};
+
+/*
+ * Heap object factory.
+ * Same make<T>() interface as scene_arena backed by make_shared, so scene builders can be written once and compared.
+ */
+struct heap_factory {
+    template <typename T, typename... Args>
+    shared_ptr<T> make(Args&&... args) {
+        return make_shared<T>(std::forward<Args>(args)...);
+    }
+};
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <algorithm>           // For std::max.
+#include <cerrno>              // For error codes.
+#include <chrono>              // For time-to-durable.
+#include <condition_variable>  // For back-pressure and durability waits.
+#include <cstdint>             // For offsets and tickets.
+#include <cstring>             // For clearing ring entries.
+#include <deque>               // For the fallback queue.
+#include <mutex>               // For the submission side.
+#include <string>              // For file paths.
+#include <thread>              // For the completion or writer thread.
+#include <utility>             // For std::move.
+#include <vector>              // For owned buffers.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define RT_HAVE_IO_URING 1
+#endif
+
+/*
+ * Asynchronous file writer for tiles, snapshots and checkpoints.
+ * write() takes ownership of a buffer and returns at once; callers only wait when queue_depth requests are already in
+ * flight, which bounds memory. sync() queues a durability point behind every earlier write and returns a ticket that
+ * wait_durable() blocks on; the writer records how long each sync took from request to stable storage.
+ * On Linux the requests go to an io_uring set up with raw system calls (no liburing): callers queue them under a short
+ * lock, and one ring thread submits them and reaps their completions. Only that thread submits because the kernel
+ * cancels a thread's requests when the thread exits. A sync is an fdatasync marked IO_DRAIN so the kernel orders it
+ * after the writes before it. Where io_uring is missing or refused, one writer thread does pwrite and fdatasync with
+ * the same ordering.
+ */
+class async_writer {
+public:
+    using ticket = std::uint64_t;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct request {
+        bool is_sync = false;
+        std::uint64_t offset = 0;
+        std::vector<unsigned char> bytes;
+        std::size_t done = 0;  // Bytes already written, after a short write
+        ticket sync_ticket = 0;
+        clock::time_point queued;
+    };
+
+    int fd = -1;
+    unsigned depth;
+    bool ring_active = false;
+
+    std::mutex lock;
+    std::condition_variable slot_freed;
+    std::condition_variable became_durable;
+    std::vector<request> slots;
+    std::vector<unsigned> free_slots;
+    ticket next_ticket = 1;
+    ticket durable_ticket = 0;
+    int first_error = 0;
+    double last_durable_seconds = 0;
+    double max_durable_seconds = 0;
+    std::uint64_t bytes_written = 0;
+
+    // Queued slot indices, consumed by the ring or writer thread.
+    std::deque<unsigned> pending;
+    std::condition_variable work_queued;
+    bool stopping = false;
+
+    std::thread worker;
+
+#if defined(RT_HAVE_IO_URING)
+    int ring_fd = -1;
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    std::size_t sq_ring_bytes = 0;
+    std::size_t cq_ring_bytes = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t sqe_bytes = 0;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    bool setup_ring() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &params));
+        if (ring_fd < 0) return false;
+        // IORING_OP_WRITE arrived in Linux 5.6 together with this feature bit; older rings use the thread instead.
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) return false;
+
+        sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+
+        sq_ring = ::mmap(nullptr, sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) return false;
+        cq_ring = single_mmap ? sq_ring
+                              : ::mmap(nullptr, cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) return false;
+        sqe_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        void* s = ::mmap(nullptr, sqe_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_SQES);
+        if (s == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(s);
+
+        auto sq_field = [&](unsigned at) { return reinterpret_cast<unsigned*>(static_cast<char*>(sq_ring) + at); };
+        auto cq_field = [&](unsigned at) { return reinterpret_cast<unsigned*>(static_cast<char*>(cq_ring) + at); };
+        sq_tail = sq_field(params.sq_off.tail);
+        sq_mask = sq_field(params.sq_off.ring_mask);
+        sq_array = sq_field(params.sq_off.array);
+        cq_head = cq_field(params.cq_off.head);
+        cq_tail = cq_field(params.cq_off.tail);
+        cq_mask = cq_field(params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ring) + params.cq_off.cqes);
+        return true;
+    }
+
+    void teardown_ring() {
+        if (sqes != MAP_FAILED) ::munmap(sqes, sqe_bytes);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) ::munmap(cq_ring, cq_ring_bytes);
+        if (sq_ring != MAP_FAILED) ::munmap(sq_ring, sq_ring_bytes);
+        if (ring_fd >= 0) ::close(ring_fd);
+        ring_fd = -1;
+    }
+
+    // Fills and submits one entry for slot `slot`; only the ring thread calls this, with `lock` held, and at most depth
+    // entries are ever in flight. Returns 0, or the errno with which the kernel refused the entry, which is then taken
+    // back off the ring.
+    int submit(unsigned slot) {
+        const request& r = slots[slot];
+        const unsigned tail = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = fd;
+        sqe.user_data = slot;
+        if (r.is_sync) {
+            sqe.opcode = IORING_OP_FSYNC;
+            sqe.flags = IOSQE_IO_DRAIN;
+            sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+        } else {
+            sqe.opcode = IORING_OP_WRITE;
+            sqe.addr = reinterpret_cast<std::uint64_t>(r.bytes.data() + r.done);
+            sqe.len = static_cast<std::uint32_t>(r.bytes.size() - r.done);
+            sqe.off = r.offset + r.done;
+        }
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        for (;;) {
+            if (::syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0) > 0) return 0;
+            // Interrupted or short of kernel memory. EBUSY means completions overflowed, which the bound on entries in
+            // flight rules out, so it cannot persist either.
+            const int error = errno;
+            if (error == EINTR || error == EAGAIN || error == EBUSY) {
+                std::this_thread::yield();
+                continue;
+            }
+            // The kernel consumed nothing, and nobody else submits, so the tail is still ours to take back.
+            __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+            return error;
+        }
+    }
+
+    void run_ring() {
+        unsigned in_flight = 0;
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            work_queued.wait(guard, [&] { return stopping || in_flight > 0 || !pending.empty(); });
+            if (pending.empty() && in_flight == 0) return;
+            for (; !pending.empty(); pending.pop_front()) {
+                const int error = submit(pending.front());
+                if (error) {
+                    complete(pending.front(), error);
+                } else {
+                    in_flight++;
+                }
+            }
+            if (in_flight == 0) continue;
+
+            // Requests queued meanwhile wait for the next completion; with at most depth in flight, one comes soon.
+            guard.unlock();
+            ::syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            guard.lock();
+            unsigned head = *cq_head;
+            const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                const unsigned slot = static_cast<unsigned>(cqe.user_data);
+                request& r = slots[slot];
+                in_flight--;
+                if (!r.is_sync && cqe.res > 0 && r.done + cqe.res < r.bytes.size()) {
+                    // Short write (rare for regular files): send the rest. A sync queued meanwhile does not wait for
+                    // it, but the next one does.
+                    r.done += cqe.res;
+                    pending.push_front(slot);
+                    continue;
+                }
+                // A write that makes no progress would never finish; the thread backend reports it as EIO too.
+                complete(slot, cqe.res < 0 ? -cqe.res : !r.is_sync && cqe.res == 0 ? EIO : 0);
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+#endif
+
+    // Retires a slot with `error` (an errno, or 0) and wakes whoever waits on it; the caller holds `lock`.
+    void complete(unsigned slot, int error) {
+        request& r = slots[slot];
+        if (error && !first_error) first_error = error;
+        if (r.is_sync) {
+            const double seconds = std::chrono::duration<double>(clock::now() - r.queued).count();
+            last_durable_seconds = seconds;
+            if (seconds > max_durable_seconds) max_durable_seconds = seconds;
+            if (r.sync_ticket > durable_ticket) durable_ticket = r.sync_ticket;
+            became_durable.notify_all();
+        } else {
+            bytes_written += error ? r.done : r.bytes.size();
+        }
+        r.bytes = std::vector<unsigned char>();
+        free_slots.push_back(slot);
+        slot_freed.notify_all();
+    }
+
+    void run_fallback() {
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            work_queued.wait(guard, [&] { return stopping || !pending.empty(); });
+            if (pending.empty()) return;
+            const unsigned slot = pending.front();
+            pending.pop_front();
+            request& r = slots[slot];
+            guard.unlock();
+
+            int error = 0;
+            if (r.is_sync) {
+                if (::fdatasync(fd) != 0) error = errno;
+            } else {
+                while (r.done < r.bytes.size()) {
+                    const ssize_t n = ::pwrite(fd, r.bytes.data() + r.done, r.bytes.size() - r.done,
+                                               static_cast<off_t>(r.offset + r.done));
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) {
+                        error = n < 0 ? errno : EIO;
+                        break;
+                    }
+                    r.done += static_cast<std::size_t>(n);
+                }
+            }
+
+            guard.lock();
+            complete(slot, error);
+        }
+    }
+
+    // Waits for a free slot, fills it and hands it to the backend.
+    ticket enqueue(request r) {
+        std::unique_lock<std::mutex> guard(lock);
+        slot_freed.wait(guard, [&] { return !free_slots.empty(); });
+        const unsigned slot = free_slots.back();
+        free_slots.pop_back();
+        r.queued = clock::now();
+        if (r.is_sync) r.sync_ticket = next_ticket++;
+        const ticket t = r.sync_ticket;
+        slots[slot] = std::move(r);
+
+        pending.push_back(slot);
+        work_queued.notify_one();
+        return t;
+    }
+
+public:
+    // Opens (creating, not truncating) `path` for writing. io_uring is used when available unless prefer_thread.
+    explicit async_writer(const std::string& path, unsigned queue_depth = 64, bool prefer_thread = false)
+        : depth(queue_depth > 0 ? queue_depth : 1), slots(depth) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return;
+        for (unsigned s = depth; s-- > 0;) free_slots.push_back(s);
+
+#if defined(RT_HAVE_IO_URING)
+        if (!prefer_thread) {
+            ring_active = setup_ring();
+            if (ring_active) {
+                worker = std::thread([this] { run_ring(); });
+                return;
+            }
+            teardown_ring();
+        }
+#else
+        (void)prefer_thread;
+#endif
+        worker = std::thread([this] { run_fallback(); });
+    }
+
+    // Finishes every queued request, then closes the file. Data is not synced unless a sync() asked for it.
+    ~async_writer() {
+        if (fd < 0) return;
+        drain();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        work_queued.notify_one();
+        worker.join();
+#if defined(RT_HAVE_IO_URING)
+        if (ring_active) teardown_ring();
+#endif
+        ::close(fd);
+    }
+
+    async_writer(const async_writer&) = delete;
+    async_writer& operator=(const async_writer&) = delete;
+
+    bool valid() const { return fd >= 0; }
+    bool uses_io_uring() const { return ring_active; }
+
+    // Queues `bytes` for writing at `offset`. Writes may complete in any order relative to each other.
+    void write(std::uint64_t offset, std::vector<unsigned char> bytes) {
+        if (fd < 0 || bytes.empty()) return;
+        request r;
+        r.offset = offset;
+        r.bytes = std::move(bytes);
+        enqueue(std::move(r));
+    }
+
+    // Queues a durability point after every write queued so far; returns its ticket.
+    ticket sync() {
+        if (fd < 0) return 0;
+        request r;
+        r.is_sync = true;
+        return enqueue(std::move(r));
+    }
+
+    // Blocks until ticket `t` is durable; false if any request has failed so far.
+    bool wait_durable(ticket t) {
+        std::unique_lock<std::mutex> guard(lock);
+        became_durable.wait(guard, [&] { return durable_ticket >= t; });
+        return first_error == 0;
+    }
+
+    // Blocks until every queued request has finished.
+    void drain() {
+        std::unique_lock<std::mutex> guard(lock);
+        slot_freed.wait(guard, [&] { return free_slots.size() == depth; });
+    }
+
+    // First error reported by the kernel (an errno value), or 0.
+    int error() {
+        std::lock_guard<std::mutex> guard(lock);
+        return first_error;
+    }
+
+    std::uint64_t written_bytes() {
+        std::lock_guard<std::mutex> guard(lock);
+        return bytes_written;
+    }
+
+    // Seconds from sync() to durable storage, for the latest completed sync and the slowest one.
+    double last_time_to_durable() {
+        std::lock_guard<std::mutex> guard(lock);
+        return last_durable_seconds;
+    }
+
+    double max_time_to_durable() {
+        std::lock_guard<std::mutex> guard(lock);
+        return max_durable_seconds;
+    }
+};
+
+#endif
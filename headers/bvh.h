@@ -0,0 +1,247 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "aligned_allocator.h"
+#include "bvh_build.h"
+#include "compiled_scene.h"
+#include "hittable.h"
+#include "sphere_accelerator.h"
+
+#include <cmath>    // For std::nextafter in conservative float rounding.
+#include <cstdint>  // For node and primitive indices.
+#include <limits>   // For float infinity.
+
+/*
+ * Conservative double-to-float rounding.
+ * Node bounds are stored as floats; rounding minima down and maxima up keeps every box a superset of its contents, so a
+ * narrower node never causes a missed hit.
+ */
+inline float round_down_float(double v) {
+    float f = static_cast<float>(v);
+    return static_cast<double>(f) > v ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+inline float round_up_float(double v) {
+    float f = static_cast<float>(v);
+    return static_cast<double>(f) < v ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+/*
+ * Flattened BVH node, 32 bytes.
+ * Nodes are stored depth-first, so an interior node's first child is always the next node and only the second child's
+ * index is stored. Two nodes share a 64-byte cache line.
+ */
+struct alignas(32) bvh_node {
+    float bounds_min[3];
+    float bounds_max[3];
+    std::uint32_t offset;  // Leaf: first primitive; interior: index of the second child
+    std::uint16_t count;   // Primitives in a leaf, 0 for interior nodes (builders cap leaf sizes far below 65535)
+    std::uint8_t axis;     // Interior: axis separating the children, for front-to-back ordering
+    std::uint8_t pad;
+
+    bool is_leaf() const { return count > 0; }
+
+    void set_bounds(const aabb& box) {
+        bounds_min[0] = round_down_float(box.x.min);
+        bounds_min[1] = round_down_float(box.y.min);
+        bounds_min[2] = round_down_float(box.z.min);
+        bounds_max[0] = round_up_float(box.x.max);
+        bounds_max[1] = round_up_float(box.y.max);
+        bounds_max[2] = round_up_float(box.z.max);
+    }
+
+    aabb bounds() const {
+        return aabb(interval(bounds_min[0], bounds_max[0]), interval(bounds_min[1], bounds_max[1]),
+                    interval(bounds_min[2], bounds_max[2]));
+    }
+
+    // Slab test against the ray's precomputed origin/reciprocal direction.
+    bool hit(const double origin[3], const double inv_dir[3], double t_min, double t_max) const {
+        for (int axis = 0; axis < 3; axis++) {
+            double t0 = (bounds_min[axis] - origin[axis]) * inv_dir[axis];
+            double t1 = (bounds_max[axis] - origin[axis]) * inv_dir[axis];
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > t_min) t_min = t0;
+            if (t1 < t_max) t_max = t1;
+            if (t_max <= t_min) return false;
+        }
+        return true;
+    }
+};
+
+static_assert(sizeof(bvh_node) == 32, "bvh_node must stay 32 bytes");
+
+/*
+ * Traversal statistics.
+ * Accumulated only through bvh::hit_with_stats, so the regular hit path carries no counting cost.
+ */
+struct bvh_traversal_stats {
+    std::uint64_t rays = 0;
+    std::uint64_t nodes_visited = 0;  // Box tests, interior and leaf
+    std::uint64_t leaves_visited = 0;
+    std::uint64_t primitive_tests = 0;
+
+    double nodes_per_ray() const { return rays ? double(nodes_visited) / rays : 0; }
+    double leaves_per_ray() const { return rays ? double(leaves_visited) / rays : 0; }
+    double primitives_per_ray() const { return rays ? double(primitive_tests) / rays : 0; }
+};
+
+// Axis along which two child boxes are most separated; interior nodes store it for ordered traversal.
+inline std::uint8_t separating_axis(const aabb& a, const aabb& b) {
+    vec3 d = a.centroid() - b.centroid();
+    double dx = std::fabs(d.x()), dy = std::fabs(d.y()), dz = std::fabs(d.z());
+    if (dx >= dy && dx >= dz) return 0;
+    return dy >= dz ? 1 : 2;
+}
+
+/*
+ * Depth-first flattening of a build tree; returns the index of the emitted subtree root.
+ * The child whose centroid is lower on the split axis is emitted first, so "positive direction visits the first child
+ * first" holds for every interior node.
+ */
+inline std::uint32_t flatten_bvh(const bvh_build_tree& tree, std::uint32_t node_index, aligned_vector<bvh_node>& out) {
+    const bvh_build_node& node = tree.nodes[node_index];
+    const std::uint32_t index = static_cast<std::uint32_t>(out.size());
+    out.emplace_back();
+    out[index].set_bounds(node.bbox);
+    out[index].pad = 0;
+
+    if (node.is_leaf()) {
+        out[index].offset = node.first;
+        out[index].count = static_cast<std::uint16_t>(node.count);
+        out[index].axis = 0;
+    } else {
+        const aabb& left_box = tree.nodes[node.left].bbox;
+        const aabb& right_box = tree.nodes[node.right].bbox;
+        const std::uint8_t axis = separating_axis(left_box, right_box);
+        const bool swap_children = left_box.axis_interval(axis).min + left_box.axis_interval(axis).max >
+                                   right_box.axis_interval(axis).min + right_box.axis_interval(axis).max;
+
+        out[index].count = 0;
+        out[index].axis = axis;
+        flatten_bvh(tree, swap_children ? node.right : node.left, out);
+        std::uint32_t second = flatten_bvh(tree, swap_children ? node.left : node.right, out);
+        out[index].offset = second;
+    }
+    return index;
+}
+
+/*
+ * Bounding volume hierarchy over a compiled scene.
+ * Spheres are copied into leaf order so every leaf is a contiguous SoA slice. The build tree is flattened into a linear
+ * array of 32-byte nodes and traversed with a small explicit stack: children are visited front-to-back by the sign of the
+ * ray direction on the node's split axis, and each node's box is tested against the current closest hit, so subtrees
+ * beyond it are skipped. Only the closest (slot, t) pair is tracked; see sphere_accelerator.
+ */
+class bvh : public sphere_accelerator {
+protected:
+    aligned_vector<bvh_node> nodes;
+
+    // Deeper than any tree the builders emit: LBVH depth is bounded by its 64 key bits, SAH depth by its median fallback.
+    // dynamic_bvh::insert rebuilds rather than split a leaf this deep.
+    static constexpr int stack_size = 128;
+
+    // With AnyHit set, returns the first sphere found inside the interval instead of the closest one.
+    template <bool CollectStats, bool AnyHit = false>
+    std::size_t traverse(const ray& r, interval ray_t, double& closest_so_far, bvh_traversal_stats* stats) const {
+        const point3& origin = r.origin();
+        const vec3 dir = r.direction();
+        const double o[3] = {origin.x(), origin.y(), origin.z()};
+        const double inv_dir[3] = {1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z()};
+        const bool dir_negative[3] = {dir.x() < 0, dir.y() < 0, dir.z() < 0};
+        const double a = dir.length_squared();
+
+        std::size_t closest = sphere_data.size();
+        if (nodes.empty()) return closest;
+        if constexpr (CollectStats) stats->rays++;
+
+        const bvh_node* node_data = nodes.data();
+        std::uint32_t stack[stack_size];
+        int top = 0;
+        std::uint32_t current = 0;
+
+        while (true) {
+            const bvh_node& node = node_data[current];
+            if constexpr (CollectStats) stats->nodes_visited++;
+
+            if (node.hit(o, inv_dir, ray_t.min, closest_so_far)) {
+                if (node.is_leaf()) {
+                    if constexpr (CollectStats) {
+                        stats->leaves_visited++;
+                        stats->primitive_tests += node.count;
+                    }
+                    for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        double t;
+                        if (sphere_data.intersect(i, origin, dir, a, interval(ray_t.min, closest_so_far), t)) {
+                            closest_so_far = t;
+                            closest = i;
+                            if constexpr (AnyHit) return closest;
+                        }
+                    }
+                } else if (dir_negative[node.axis]) {
+                    // The second child lies on the near side; defer the first.
+                    stack[top++] = current + 1;
+                    current = node.offset;
+                    continue;
+                } else {
+                    stack[top++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (top == 0) break;
+            current = stack[--top];
+        }
+        return closest;
+    }
+
+public:
+    explicit bvh(const compiled_scene& scene, bvh_builder builder = bvh_builder::binned_sah, unsigned threads = 0,
+                 int sah_bins = 32)
+        : sphere_accelerator(scene) {
+        bvh_build_tree tree = build_tree(scene, builder, threads, sah_bins);
+        if (!tree.nodes.empty()) {
+            nodes.reserve(tree.nodes.size());
+            flatten_bvh(tree, tree.root, nodes);
+        }
+    }
+
+    std::size_t node_count() const { return nodes.size(); }
+    std::size_t node_bytes() const { return nodes.size() * sizeof(bvh_node); }
+
+    // SAH cost of the tree (see bvh_build.h); lower means fewer expected node visits and sphere tests per ray.
+    double sah_cost() const {
+        if (nodes.empty()) return 0;
+        double root_area = nodes[0].bounds().surface_area();
+        if (root_area <= 0) return 0;
+        double cost = 0;
+        for (const auto& node : nodes) {
+            double p = node.bounds().surface_area() / root_area;
+            cost += node.is_leaf() ? p * node.count : p;
+        }
+        return cost;
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return hit_with_stats(r, ray_t, rec, nullptr);
+    }
+
+    // Closest hit, optionally accumulating per-ray traversal counts into `stats`.
+    bool hit_with_stats(const ray& r, interval ray_t, hit_record& rec, bvh_traversal_stats* stats) const {
+        double closest_so_far = ray_t.max;
+        std::size_t closest = stats ? traverse<true>(r, ray_t, closest_so_far, stats)
+                                    : traverse<false>(r, ray_t, closest_so_far, nullptr);
+        return finish_hit(r, ray_t, closest, closest_so_far, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        double closest_so_far = ray_t.max;
+        return traverse<false, true>(r, ray_t, closest_so_far, nullptr) < sphere_data.size() ||
+               others_occluded(other_objects, r, ray_t);
+    }
+};
+
+#endif
@@ -0,0 +1,462 @@
+#ifndef BVH_BUILD_H
+#define BVH_BUILD_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "parallel.h"
+
+#include <algorithm>  // For std::min/max and histogram clearing.
+#include <atomic>     // For the bottom-up bounds pass.
+#include <cstdint>    // For 32-bit node and primitive indices.
+#include <memory>     // For the atomic visit-flag array.
+#include <thread>     // For parallel subtree recursion.
+#include <vector>     // For node and permutation storage.
+
+/*
+ * BVH build tree.
+ * Builder output shared by every BVH variant: a binary tree over primitive bounds plus the permutation that makes each
+ * leaf's primitives contiguous. Traversal layouts (flat, wide, compressed) are produced from this tree, so builders and
+ * layouts can be mixed freely.
+ */
+struct bvh_build_node {
+    aabb bbox;
+    std::uint32_t left = 0, right = 0;  // Child node indices; unused for leaves
+    std::uint32_t first = 0, count = 0; // Range into prim_order; count > 0 marks a leaf
+
+    bool is_leaf() const { return count > 0; }
+};
+
+struct bvh_build_tree {
+    std::vector<bvh_build_node> nodes;
+    std::vector<std::uint32_t> prim_order;  // prim_order[k] = original index of the k-th primitive in leaf order
+    std::uint32_t root = 0;
+};
+
+/*
+ * SAH cost of a finished tree.
+ * Expected cost of a random ray that hits the root box, with unit traversal and intersection costs: each node is weighted
+ * by the probability SA(node)/SA(root) of being visited. Lower is better; used to compare builders.
+ */
+inline double sah_cost(const bvh_build_tree& tree, double traversal_cost = 1.0, double intersection_cost = 1.0) {
+    if (tree.nodes.empty()) return 0;
+    double root_area = tree.nodes[tree.root].bbox.surface_area();
+    if (root_area <= 0) return 0;
+
+    double cost = 0;
+    for (const auto& node : tree.nodes) {
+        double p = node.bbox.surface_area() / root_area;
+        cost += node.is_leaf() ? p * node.count * intersection_cost : p * traversal_cost;
+    }
+    return cost;
+}
+
+namespace lbvh_detail {
+
+// Spreads the low 10 bits of v so that there are two zero bits between each.
+inline std::uint32_t expand_bits(std::uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// 30-bit Morton code of a point already normalized to the unit cube.
+inline std::uint32_t morton3(double x, double y, double z) {
+    auto quantize = [](double v) {
+        v *= 1024.0;
+        if (v < 0) v = 0;
+        if (v > 1023) v = 1023;
+        return static_cast<std::uint32_t>(v);
+    };
+    return (expand_bits(quantize(x)) << 2) | (expand_bits(quantize(y)) << 1) | expand_bits(quantize(z));
+}
+
+/*
+ * Parallel LSD radix sort of 64-bit keys on bytes [first_byte, last_byte).
+ * Each chunk histograms its slice, a serial prefix over (digit, chunk) assigns output offsets, and each chunk scatters
+ * its slice; stable, so keys tie-broken by their low bits stay ordered.
+ */
+inline void radix_sort(std::vector<std::uint64_t>& keys, int first_byte, int last_byte, unsigned threads) {
+    const std::size_t n = keys.size();
+    unsigned chunks = worker_count(threads);
+    if (n / chunks < 4096) chunks = 1;
+
+    std::vector<std::uint64_t> scratch(n);
+    std::vector<std::size_t> offsets(static_cast<std::size_t>(chunks) * 256);
+
+    for (int byte = first_byte; byte < last_byte; byte++) {
+        const int shift = 8 * byte;
+        std::fill(offsets.begin(), offsets.end(), 0);
+
+        parallel_chunks(n, chunks, [&](unsigned c, std::size_t begin, std::size_t end) {
+            std::size_t* hist = &offsets[static_cast<std::size_t>(c) * 256];
+            for (std::size_t i = begin; i < end; i++) hist[(keys[i] >> shift) & 0xFF]++;
+        });
+
+        std::size_t sum = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            for (unsigned c = 0; c < chunks; c++) {
+                std::size_t& slot = offsets[static_cast<std::size_t>(c) * 256 + digit];
+                std::size_t count = slot;
+                slot = sum;
+                sum += count;
+            }
+        }
+
+        parallel_chunks(n, chunks, [&](unsigned c, std::size_t begin, std::size_t end) {
+            std::size_t* offset = &offsets[static_cast<std::size_t>(c) * 256];
+            for (std::size_t i = begin; i < end; i++) scratch[offset[(keys[i] >> shift) & 0xFF]++] = keys[i];
+        });
+
+        keys.swap(scratch);
+    }
+}
+
+// Length of the common key prefix of sorted keys i and j; -1 outside the array (Karras 2012).
+inline int delta(const std::vector<std::uint64_t>& keys, std::int64_t i, std::int64_t j) {
+    if (j < 0 || j >= static_cast<std::int64_t>(keys.size())) return -1;
+    return __builtin_clzll(keys[i] ^ keys[j]);
+}
+
+} // namespace lbvh_detail
+
+/*
+ * Linear BVH builder.
+ * Morton codes of primitive centroids (parallel), a parallel radix sort, then Karras-style hierarchy emission where every
+ * internal node finds its own key range and split independently (parallel), followed by a parallel bottom-up bounds pass.
+ * Leaves hold one primitive each. Build cost is O(n) and fully parallel, at the price of a worse SAH cost than a
+ * top-down SAH build; keys carry the primitive index in their low 32 bits, so duplicate codes need no special case.
+ */
+inline bvh_build_tree build_lbvh(const std::vector<aabb>& bounds, unsigned threads = 0) {
+    using namespace lbvh_detail;
+
+    bvh_build_tree tree;
+    const std::size_t n = bounds.size();
+    if (n == 0) return tree;
+
+    tree.nodes.resize(2 * n - 1);
+    tree.prim_order.resize(n);
+    if (n == 1) {
+        tree.nodes[0].bbox = bounds[0];
+        tree.nodes[0].count = 1;
+        return tree;
+    }
+
+    // Morton keys over the centroid bounds, which are tighter than the primitive bounds for uneven sizes.
+    aabb centroid_bounds;
+    for (const auto& b : bounds) {
+        point3 c = b.centroid();
+        centroid_bounds = aabb(centroid_bounds, aabb(c, c));
+    }
+    auto extent = [](const interval& ax) { return ax.size() > 0 ? 1.0 / ax.size() : 0.0; };
+    const double sx = extent(centroid_bounds.x), sy = extent(centroid_bounds.y), sz = extent(centroid_bounds.z);
+
+    std::vector<std::uint64_t> keys(n);
+    parallel_for(n, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++) {
+            point3 c = bounds[i].centroid();
+            std::uint64_t code = morton3((c.x() - centroid_bounds.x.min) * sx,
+                                         (c.y() - centroid_bounds.y.min) * sy,
+                                         (c.z() - centroid_bounds.z.min) * sz);
+            keys[i] = (code << 32) | i;
+        }
+    }, threads);
+
+    // Keys start ordered by index, so sorting only the code bytes (4..7) yields (code, index) order.
+    radix_sort(keys, 4, 8, threads);
+
+    // Internal nodes occupy [0, n-1), leaves [n-1, 2n-1); leaf k holds the k-th sorted primitive.
+    const std::uint32_t leaf_base = static_cast<std::uint32_t>(n - 1);
+    std::vector<std::uint32_t> parent(2 * n - 1, 0);
+
+    parallel_for(n, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin; k < end; k++) {
+            tree.prim_order[k] = static_cast<std::uint32_t>(keys[k] & 0xFFFFFFFFu);
+            auto& leaf = tree.nodes[leaf_base + k];
+            leaf.bbox = bounds[tree.prim_order[k]];
+            leaf.first = static_cast<std::uint32_t>(k);
+            leaf.count = 1;
+        }
+    }, threads);
+
+    parallel_for(n - 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t node = begin; node < end; node++) {
+            const std::int64_t i = static_cast<std::int64_t>(node);
+
+            // Direction of the range and an upper bound on its length.
+            const int d = (delta(keys, i, i + 1) - delta(keys, i, i - 1)) >= 0 ? 1 : -1;
+            const int delta_min = delta(keys, i, i - d);
+            std::int64_t l_max = 2;
+            while (delta(keys, i, i + l_max * d) > delta_min) l_max *= 2;
+
+            // Binary search for the other end of the range.
+            std::int64_t l = 0;
+            for (std::int64_t t = l_max / 2; t >= 1; t /= 2) {
+                if (delta(keys, i, i + (l + t) * d) > delta_min) l += t;
+            }
+            const std::int64_t j = i + l * d;
+
+            // Binary search for the split position within the range.
+            const int delta_node = delta(keys, i, j);
+            std::int64_t s = 0;
+            for (std::int64_t divider = 2;; divider *= 2) {
+                std::int64_t t = (l + divider - 1) / divider;
+                if (delta(keys, i, i + (s + t) * d) > delta_node) s += t;
+                if (t <= 1) break;
+            }
+            const std::int64_t gamma = i + s * d + (d < 0 ? -1 : 0);
+
+            auto& out = tree.nodes[node];
+            out.left = static_cast<std::uint32_t>(std::min(i, j) == gamma ? leaf_base + gamma : gamma);
+            out.right = static_cast<std::uint32_t>(std::max(i, j) == gamma + 1 ? leaf_base + gamma + 1 : gamma + 1);
+            out.count = 0;
+            parent[out.left] = static_cast<std::uint32_t>(node);
+            parent[out.right] = static_cast<std::uint32_t>(node);
+        }
+    }, threads);
+
+    // Bottom-up bounds: the second child to arrive at a parent computes its box and keeps climbing.
+    std::unique_ptr<std::atomic<std::uint32_t>[]> visits(new std::atomic<std::uint32_t>[n - 1]);
+    for (std::size_t i = 0; i < n - 1; i++) visits[i].store(0, std::memory_order_relaxed);
+
+    parallel_for(n, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin; k < end; k++) {
+            std::uint32_t node = leaf_base + static_cast<std::uint32_t>(k);
+            while (node != tree.root) {
+                node = parent[node];
+                if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0) break;
+                auto& internal = tree.nodes[node];
+                internal.bbox = aabb(tree.nodes[internal.left].bbox, tree.nodes[internal.right].bbox);
+            }
+        }
+    }, threads);
+
+    return tree;
+}
+
+namespace sah_detail {
+
+struct bin {
+    aabb bounds;
+    std::uint32_t count = 0;
+};
+
+/*
+ * Recursive binned SAH build over prim_order[begin, end).
+ * Nodes are appended to `out`; the returned index is the subtree root. Large subtrees build their left child on a new
+ * thread into a private node vector that is spliced back afterwards, so threads never share a growing vector.
+ */
+class builder {
+private:
+    const std::vector<aabb>& bounds;
+    std::vector<point3> centroids;
+    std::vector<std::uint32_t>& order;
+    int bin_count;
+    std::uint32_t max_leaf_size;
+
+    static constexpr std::uint32_t parallel_threshold = 4096;  // Below this a thread costs more than the subtree
+    static constexpr int median_depth = 64;  // Past this depth force median splits, bounding tree depth for traversal stacks
+
+    static double axis_of(const point3& p, int axis) { return axis == 0 ? p.x() : (axis == 1 ? p.y() : p.z()); }
+
+    void median_split(std::uint32_t begin, std::uint32_t end, int axis, std::uint32_t& mid) {
+        mid = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                         [&](std::uint32_t a, std::uint32_t b) {
+                             return axis_of(centroids[a], axis) < axis_of(centroids[b], axis);
+                         });
+    }
+
+public:
+    builder(const std::vector<aabb>& bounds, std::vector<std::uint32_t>& order, int bin_count,
+            std::uint32_t max_leaf_size)
+        : bounds(bounds), centroids(bounds.size()), order(order), bin_count(bin_count), max_leaf_size(max_leaf_size) {
+        for (std::size_t i = 0; i < bounds.size(); i++) centroids[i] = bounds[i].centroid();
+    }
+
+    std::uint32_t build(std::vector<bvh_build_node>& out, std::uint32_t begin, std::uint32_t end, int depth,
+                        int parallel_depth) {
+        const std::uint32_t index = static_cast<std::uint32_t>(out.size());
+        out.emplace_back();
+
+        aabb node_bounds, centroid_bounds;
+        for (std::uint32_t k = begin; k < end; k++) {
+            node_bounds = aabb(node_bounds, bounds[order[k]]);
+            centroid_bounds = aabb(centroid_bounds, aabb(centroids[order[k]], centroids[order[k]]));
+        }
+        out[index].bbox = node_bounds;
+
+        const std::uint32_t count = end - begin;
+        auto make_leaf = [&] {
+            out[index].first = begin;
+            out[index].count = count;
+            return index;
+        };
+        if (count <= 1) return make_leaf();
+
+        int axis = centroid_bounds.longest_axis();
+        const interval& extent = centroid_bounds.axis_interval(axis);
+        std::uint32_t mid = begin + count / 2;
+
+        if (extent.size() <= 0 || depth >= median_depth) {
+            // Coincident centroids cannot be separated by binning, and very deep ranges switch to median splits so the
+            // depth stays logarithmic from here on; either way small ranges simply become leaves.
+            if (count <= max_leaf_size) return make_leaf();
+            median_split(begin, end, axis, mid);
+        } else if (!find_split(begin, end, centroid_bounds, node_bounds, axis, mid)) {
+            return make_leaf();
+        }
+
+        std::uint32_t left, right;
+        if (parallel_depth > 0 && count >= parallel_threshold) {
+            std::vector<bvh_build_node> left_nodes;
+            std::uint32_t local_left = 0;
+            std::thread worker([&] { local_left = build(left_nodes, begin, mid, depth + 1, parallel_depth - 1); });
+            right = build(out, mid, end, depth + 1, parallel_depth - 1);
+            worker.join();
+
+            const std::uint32_t offset = static_cast<std::uint32_t>(out.size());
+            for (auto& node : left_nodes) {
+                if (!node.is_leaf()) {
+                    node.left += offset;
+                    node.right += offset;
+                }
+                out.push_back(node);
+            }
+            left = local_left + offset;
+        } else {
+            left = build(out, begin, mid, depth + 1, parallel_depth);
+            right = build(out, mid, end, depth + 1, parallel_depth);
+        }
+
+        out[index].left = left;
+        out[index].right = right;
+        return index;
+    }
+
+private:
+    /*
+     * Bins centroids along each axis, sweeps prefix/suffix bounds to evaluate every bin boundary, and partitions the
+     * range at the cheapest one. Returns false when a leaf is cheaper than any split.
+     */
+    bool find_split(std::uint32_t begin, std::uint32_t end, const aabb& centroid_bounds, const aabb& node_bounds,
+                    int& best_axis, std::uint32_t& mid) {
+        const std::uint32_t count = end - begin;
+        const int n = bin_count;
+        std::vector<bin> bins(n);
+        std::vector<double> right_area(n);
+        std::vector<std::uint32_t> right_count(n);
+
+        double best_cost = infinity;
+        int best_split = -1;
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& extent = centroid_bounds.axis_interval(axis);
+            if (extent.size() <= 0) continue;
+            const double scale = n / extent.size();
+
+            std::fill(bins.begin(), bins.end(), bin());
+            for (std::uint32_t k = begin; k < end; k++) {
+                int b = static_cast<int>((axis_of(centroids[order[k]], axis) - extent.min) * scale);
+                if (b >= n) b = n - 1;
+                bins[b].count++;
+                bins[b].bounds = aabb(bins[b].bounds, bounds[order[k]]);
+            }
+
+            aabb acc;
+            std::uint32_t acc_count = 0;
+            for (int b = n - 1; b > 0; b--) {
+                acc = aabb(acc, bins[b].bounds);
+                acc_count += bins[b].count;
+                right_area[b] = acc.surface_area();
+                right_count[b] = acc_count;
+            }
+
+            acc = aabb();
+            acc_count = 0;
+            for (int b = 0; b < n - 1; b++) {
+                acc = aabb(acc, bins[b].bounds);
+                acc_count += bins[b].count;
+                if (acc_count == 0 || right_count[b + 1] == 0) continue;
+                double cost = acc_count * acc.surface_area() + right_count[b + 1] * right_area[b + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b;
+                }
+            }
+        }
+
+        // Unit traversal and intersection costs, normalized by the parent area; a leaf costs one test per primitive.
+        const double area = node_bounds.surface_area();
+        const double split_cost = (best_split >= 0 && area > 0) ? 1.0 + best_cost / area : infinity;
+        if (count <= max_leaf_size && split_cost >= count) return false;
+
+        if (best_split < 0) {
+            // Too many primitives for a leaf but no usable bin boundary (e.g. all centroids in one bin).
+            median_split(begin, end, best_axis, mid);
+            return true;
+        }
+
+        const interval& extent = centroid_bounds.axis_interval(best_axis);
+        const double scale = n / extent.size();
+        auto it = std::partition(order.begin() + begin, order.begin() + end, [&](std::uint32_t p) {
+            int b = static_cast<int>((axis_of(centroids[p], best_axis) - extent.min) * scale);
+            if (b >= n) b = n - 1;
+            return b <= best_split;
+        });
+        mid = static_cast<std::uint32_t>(it - order.begin());
+        if (mid == begin || mid == end) mid = begin + count / 2;
+        return true;
+    }
+};
+
+} // namespace sah_detail
+
+/*
+ * Binned SAH builder.
+ * Top-down: each node bins primitive centroids into `bins` buckets per axis (16-64 is the useful range) and splits at the
+ * bin boundary with the lowest surface-area-heuristic cost, or becomes a leaf when that is cheaper; subtrees near the root
+ * are built on parallel threads. Handles strongly non-uniform scenes (a huge ground sphere among tiny spheres) far better
+ * than median splits, since the cost accounts for how much space each child's box covers.
+ */
+inline bvh_build_tree build_binned_sah(const std::vector<aabb>& bounds, int bins = 32, unsigned threads = 0,
+                                       std::uint32_t max_leaf_size = 4) {
+    bvh_build_tree tree;
+    const std::size_t n = bounds.size();
+    if (n == 0) return tree;
+
+    tree.prim_order.resize(n);
+    for (std::size_t i = 0; i < n; i++) tree.prim_order[i] = static_cast<std::uint32_t>(i);
+
+    // Parallel recursion depth: enough levels that every worker gets at least one subtree.
+    int parallel_depth = 0;
+    for (unsigned w = worker_count(threads); w > 1; w = (w + 1) / 2) parallel_depth++;
+
+    bins = bins < 2 ? 2 : (bins > 256 ? 256 : bins);
+    tree.nodes.reserve(2 * n / (max_leaf_size > 0 ? max_leaf_size : 1) + 1);
+    sah_detail::builder b(bounds, tree.prim_order, bins, max_leaf_size > 0 ? max_leaf_size : 1);
+    tree.root = b.build(tree.nodes, 0, static_cast<std::uint32_t>(n), 0, parallel_depth);
+    return tree;
+}
+
+/*
+ * Builder selection.
+ * lbvh trades tree quality for a fully parallel O(n) build; binned_sah gives the best trees and is the default.
+ */
+enum class bvh_builder {
+    lbvh,
+    binned_sah,
+};
+
+inline bvh_build_tree build_bvh_tree(const std::vector<aabb>& bounds, bvh_builder builder, unsigned threads = 0,
+                                     int sah_bins = 32) {
+    switch (builder) {
+        case bvh_builder::lbvh: return build_lbvh(bounds, threads);
+        case bvh_builder::binned_sah: break;
+    }
+    return build_binned_sah(bounds, sah_bins, threads);
+}
+
+#endif
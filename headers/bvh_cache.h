@@ -0,0 +1,225 @@
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+#include "rtweekend.h"
+#include "bvh.h"
+#include "compiled_scene.h"
+#include "hittable.h"
+#include "mapped_file.h"
+#include "sphere_accelerator.h"
+#include "wide_bvh.h"
+
+#include <cstdint>  // For the fixed-width header fields.
+#include <cstring>  // For the magic and word-wise hashing.
+#include <limits>   // For the empty-slot bounds.
+#include <string>   // For paths.
+#include <vector>   // For the material and object tables.
+
+/*
+ * Content hash of a compiled scene: FNV-1a over the 64-bit words of the sphere arrays, the same word-wise variant the
+ * material registry uses, plus the material and object counts. Materials are objects rather than data, so scenes are
+ * assumed to intern them in a deterministic order, as the scene builders here do.
+ */
+inline std::uint64_t scene_content_hash(const compiled_scene& scene) {
+    std::uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](std::uint64_t word) { h = (h ^ word) * 1099511628211ull; };
+    auto mix_doubles = [&mix](const aligned_vector<double>& values) {
+        for (double v : values) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            mix(bits);
+        }
+    };
+
+    const sphere_soa& spheres = scene.spheres();
+    mix(spheres.size());
+    mix(scene.materials().size());
+    mix(scene.others().size());
+    mix_doubles(spheres.center_x);
+    mix_doubles(spheres.center_y);
+    mix_doubles(spheres.center_z);
+    mix_doubles(spheres.radius);
+    for (auto id : spheres.material_id) mix(id);
+    return h;
+}
+
+/*
+ * Cache file layout, native endianness: this header, then the wide node array, the five sphere arrays and the
+ * primitive ids as mapped_file.h sections, so a mapped file can be traced in place with aligned loads.
+ * Bump bvh_cache_version whenever the node or sphere layout changes; node_size guards against silent mismatches.
+ */
+constexpr char bvh_cache_magic[8] = {'R', 'T', 'B', 'V', 'H', 'C', 'A', 'C'};
+constexpr std::uint32_t bvh_cache_version = 1;
+
+struct bvh_cache_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t node_width;
+    std::uint64_t node_size;
+    std::uint64_t scene_hash;
+    std::uint64_t sphere_count;
+    std::uint64_t material_count;
+    std::uint64_t node_count;
+    std::uint64_t section_offset[7];  // Nodes, center x/y/z, radius, material ids, primitive ids
+    std::uint64_t file_size;
+};
+
+// Writes a built wide BVH and its leaf-ordered spheres; returns false if the file cannot be written.
+template <int N>
+bool write_bvh_cache(const std::string& path, const wide_bvh<N>& accel, std::uint64_t scene_hash,
+                     std::size_t material_count) {
+    const sphere_soa& spheres = accel.spheres();
+    const auto& nodes = accel.node_array();
+    const std::vector<std::uint32_t>& ids = accel.primitive_ids();
+
+    const void* sections[7] = {nodes.data(),          spheres.center_x.data(), spheres.center_y.data(),
+                               spheres.center_z.data(), spheres.radius.data(),  spheres.material_id.data(),
+                               ids.data()};
+    const std::size_t n = spheres.size();
+    const std::uint64_t lengths[7] = {nodes.size() * sizeof(wide_bvh_node<N>), n * sizeof(double), n * sizeof(double),
+                                      n * sizeof(double), n * sizeof(double), n * sizeof(std::uint32_t),
+                                      n * sizeof(std::uint32_t)};
+
+    bvh_cache_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, bvh_cache_magic, sizeof(header.magic));
+    header.version = bvh_cache_version;
+    header.node_width = N;
+    header.node_size = sizeof(wide_bvh_node<N>);
+    header.scene_hash = scene_hash;
+    header.sphere_count = n;
+    header.material_count = material_count;
+    header.node_count = nodes.size();
+    header.file_size = layout_sections(sizeof(header), lengths, 7, header.section_offset);
+
+    return write_section_file(path, &header, sizeof(header), sections, lengths, header.section_offset, 7,
+                              header.file_size);
+}
+
+/*
+ * Wide BVH traced straight out of a mapped cache file.
+ * Nothing is copied or rebuilt: the node and sphere arrays are views into the mapping. Materials and non-sphere
+ * objects still come from the compiled scene, which the cache was validated against by content hash. valid() is false
+ * when the file is missing, truncated, of another version or width, or built for a different scene.
+ */
+template <int N>
+class mapped_wide_bvh : public hittable {
+private:
+    // Levels below the root that traverse_wide's fixed stack of 128 * N entries can hold.
+    static constexpr int max_cache_depth = 127;
+
+    mapped_file file;
+    const wide_bvh_node<N>* nodes = nullptr;
+    std::size_t node_total = 0;
+    sphere_view sphere_data{nullptr, nullptr, nullptr, nullptr, nullptr, 0};
+    const std::uint32_t* prim_ids = nullptr;
+    std::vector<shared_ptr<material>> material_table;
+    std::vector<shared_ptr<hittable>> other_objects;
+    aabb bbox;
+
+    bool validate(const compiled_scene& scene, std::uint64_t scene_hash) {
+        if (!file.is_open() || file.size() < sizeof(bvh_cache_header)) return false;
+        bvh_cache_header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, bvh_cache_magic, sizeof(header.magic)) != 0) return false;
+        if (header.version != bvh_cache_version || header.node_width != N) return false;
+        if (header.node_size != sizeof(wide_bvh_node<N>) || header.file_size != file.size()) return false;
+        if (header.scene_hash != scene_hash || header.sphere_count != scene.spheres().size()) return false;
+        if (header.material_count != scene.materials().size()) return false;
+
+        const std::uint64_t n = header.sphere_count;
+        if (n > file.size() || header.node_count > file.size()) return false;
+        const std::uint64_t lengths[7] = {header.node_count * sizeof(wide_bvh_node<N>), n * sizeof(double),
+                                          n * sizeof(double), n * sizeof(double), n * sizeof(double),
+                                          n * sizeof(std::uint32_t), n * sizeof(std::uint32_t)};
+        if (!sections_in_bounds(header.section_offset, lengths, 7, file.size())) return false;
+
+        auto section = [&](int s) { return file.data() + header.section_offset[s]; };
+        nodes = reinterpret_cast<const wide_bvh_node<N>*>(section(0));
+        node_total = header.node_count;
+        sphere_data = {reinterpret_cast<const double*>(section(1)), reinterpret_cast<const double*>(section(2)),
+                       reinterpret_cast<const double*>(section(3)), reinterpret_cast<const double*>(section(4)),
+                       reinterpret_cast<const std::uint32_t*>(section(5)), n};
+        prim_ids = reinterpret_cast<const std::uint32_t*>(section(6));
+        return indices_in_range(header.material_count);
+    }
+
+    /*
+     * One pass over the mapped arrays so a corrupted cache with a matching header cannot send traversal out of bounds:
+     * interior children must point forward (the builder writes nodes in preorder, which also rules out cycles) within
+     * the traversal stack's depth, leaf batches must lie inside the sphere arrays, empty slots must hold the inverted
+     * box that fails every test, and primitive and material ids must be in range.
+     */
+    bool indices_in_range(std::uint64_t material_count) const {
+        const std::uint64_t n = sphere_data.size();
+        const float inf = std::numeric_limits<float>::infinity();
+        std::vector<std::uint8_t> depth(node_total, 0);
+        for (std::size_t k = 0; k < node_total; k++) {
+            const wide_bvh_node<N>& node = nodes[k];
+            for (int i = 0; i < N; i++) {
+                if (node.count[i] > 0) {
+                    if (std::uint64_t(node.child[i]) + node.count[i] > n) return false;
+                } else if (node.child[i] == 0) {
+                    if (node.min_x[i] != inf || node.min_y[i] != inf || node.min_z[i] != inf ||
+                        node.max_x[i] != -inf || node.max_y[i] != -inf || node.max_z[i] != -inf) {
+                        return false;
+                    }
+                } else {
+                    if (node.child[i] <= k || node.child[i] >= node_total || depth[k] >= max_cache_depth) return false;
+                    depth[node.child[i]] = static_cast<std::uint8_t>(depth[k] + 1);
+                }
+            }
+        }
+        for (std::uint64_t i = 0; i < n; i++) {
+            if (prim_ids[i] >= n || sphere_data.material_id[i] >= material_count) return false;
+        }
+        return true;
+    }
+
+public:
+    mapped_wide_bvh(const std::string& path, const compiled_scene& scene, std::uint64_t scene_hash)
+        : file(path), material_table(scene.materials()), other_objects(scene.others()), bbox(scene.bounding_box()) {
+        if (!validate(scene, scene_hash)) file = mapped_file();
+    }
+
+    bool valid() const { return file.is_open(); }
+    std::size_t node_count() const { return node_total; }
+    std::size_t primitive_count() const { return sphere_data.size(); }
+
+    // Original primitive id of sphere slot i, as in sphere_accelerator::primitive_ids().
+    std::uint32_t primitive_id(std::size_t i) const { return prim_ids[i]; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        double closest_so_far = ray_t.max;
+        std::size_t closest =
+            traverse_wide<N, false>(nodes, node_total, sphere_data, r, ray_t, closest_so_far, nullptr);
+        return finish_sphere_hit(sphere_data, material_table, other_objects, r, ray_t, closest, closest_so_far, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        double closest_so_far = ray_t.max;
+        return traverse_wide<N, false, true>(nodes, node_total, sphere_data, r, ray_t, closest_so_far, nullptr) <
+                   sphere_data.size() ||
+               others_occluded(other_objects, r, ray_t);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+};
+
+/*
+ * Returns a wide BVH for the scene, mapped from `path` when a matching cache exists; otherwise builds one and writes
+ * the cache for the next run. A cache that cannot be written only costs the rebuild next time.
+ */
+template <int N>
+shared_ptr<hittable> load_or_build_wide_bvh(const compiled_scene& scene, const std::string& path) {
+    const std::uint64_t hash = scene_content_hash(scene);
+    auto mapped = make_shared<mapped_wide_bvh<N>>(path, scene, hash);
+    if (mapped->valid()) return mapped;
+
+    auto built = make_shared<wide_bvh<N>>(scene);
+    write_bvh_cache(path, *built, hash, scene.materials().size());
+    return built;
+}
+
+#endif
@@ -1,8 +1,21 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "accumulation_buffer.h"
+#include "framebuffer.h"
 #include "hittable.h"
+#include "image_writer.h"
 #include "material.h"
+#include "parallel.h"
+#include "progress.h"
+#include "render_stats.h"
+#include "tile_sink.h"
+
+#include <algorithm>  // For clamping tiles to the image.
+#include <atomic>     // For the shared tile counter.
+#include <cstdint>    // For tile seeds.
+#include <thread>     // For waiting on a tile's previous pass.
+#include <vector>     // For per-worker tiles.
 
 class camera {
   	private:
@@ -17,8 +30,7 @@ class camera {
     		vec3   defocus_disk_v;       // Defocus disk vertical radius
 
 		void initialize() {
-			image_height = static_cast<int>(image_width / aspect_ratio);
-			image_height = (image_height < 1) ? 1 : image_height;
+			image_height = output_height();
 
 			pixel_samples_scale = 1.0 / samples_per_pixel;
 
@@ -66,6 +78,41 @@ class camera {
 			return ray(ray_origin, ray_direction);
 		}
 
+		// Sample seed of a tile; seeding by tile keeps the image the same whichever thread renders which tile, and each
+		// accumulation pass gets its own sequence.
+		static std::uint64_t tile_seed(int tile, std::uint64_t pass = 0) {
+			return 0x5DEECE66Dull * (static_cast<std::uint64_t>(tile) + 1) + pass * 0x9E3779B97F4A7C15ull;
+		}
+
+		// Pixels of the tile_size tile at (x0, y0) that lie inside the image.
+		std::uint64_t tile_area(int x0, int y0) const {
+			return static_cast<std::uint64_t>(std::min(tile_size, image_width - x0)) *
+				   static_cast<std::uint64_t>(std::min(tile_size, image_height - y0));
+		}
+
+		// Renders the edge x edge tile at (x0, y0) into `out`, rows `stride` pixels apart, as sums of samples_per_pixel
+		// samples times `scale`. Returns the number of rays traced.
+		std::uint64_t render_tile(const hittable& world, std::uint64_t seed, int x0, int y0, int edge, double scale,
+								  color* out, std::size_t stride) const {
+			scoped_sample_rng rng(seed);
+			std::uint64_t rays = 0;
+
+			const int x1 = std::min(x0 + edge, image_width);
+			const int y1 = std::min(y0 + edge, image_height);
+			for (int j = y0; j < y1; j++) {
+				color* row = out + (j - y0) * stride;
+				for (int i = x0; i < x1; i++) {
+					color pixel_color(0,0,0);
+					for (int sample = 0; sample < samples_per_pixel; sample++) {
+						ray r = get_ray(i, j);
+						pixel_color += ray_color(r, max_depth, world, rays);
+					}
+					row[i - x0] = scale * pixel_color;
+				}
+			}
+			return rays;
+		}
+
 		vec3 sample_square() const {
 			// Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit square.
 			return vec3(random_double() - 0.5, random_double() - 0.5, 0);
@@ -77,10 +124,17 @@ class camera {
 			return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
 		}
 
-	    	color ray_color(const ray& r, int depth, const hittable& world) const {
+	    	color ray_color(const ray& r, int depth, const hittable& world, std::uint64_t& rays) const {
 			if (depth <= 0) {
+				RT_STAT(depth_cutoffs);
 				return color(0, 0, 0);
 			}
+			rays++;
+			if (depth == max_depth) {
+				RT_STAT(primary_rays);
+			} else {
+				RT_STAT(secondary_rays);
+			}
 
 			// gama level splitter 
 			/*vec3 unit_direction = unit_vector(vec3(r.direction().x(), 0, r.direction().z()));
@@ -104,14 +158,17 @@ class camera {
 			hit_record rec; 
 
 			if (world.hit(r, interval(0.001, infinity), rec)) {
+				RT_STAT(hits);
 				ray scattered;
 				color attenuation;
 				if (rec.mat->scatter(r, rec, attenuation, scattered))
 				{
-					return attenuation * ray_color(scattered, depth - 1, world);
+					return attenuation * ray_color(scattered, depth - 1, world, rays);
 				}
+				RT_STAT(absorptions);
 				return color(0,0,0);
 			}
+			RT_STAT(misses);
 
 			vec3 unit_direction = unit_vector(r.direction());
 			auto a = b*(unit_direction.y() + 1.0);
@@ -132,23 +189,146 @@ class camera {
 	    	double defocus_angle = 0;  // Variation angle of rays through each pixel
 	    	double focus_dist = 10;    // Distance from camera lookfrom point to plane of perfect focus
 
+	    	int      tile_size   = 32;   // Tile edge in pixels; also the height of an output band
+	    	int      window_rows = 256;  // Rows kept in memory before they must be written out
+	    	unsigned threads     = 0;    // Render threads; 0 means one per hardware thread
+
+	    	dither_mode dither = dither_mode::none;  // Ordered dithering of 8-bit output
+
+	    	double progress_interval = 0.5;  // Seconds between progress reports on std::clog; 0 turns them off
+
+		// Image height implied by image_width and aspect_ratio; size framebuffers with it.
+		int output_height() const {
+			int height = static_cast<int>(image_width / aspect_ratio);
+			return (height < 1) ? 1 : height;
+		}
+
+		/*
+		 * Parallel tiled render.
+		 * Workers take tiles in row-major order from a shared counter. Finished rows stream to std::cout in order as
+		 * soon as their band is complete, so only window_rows rows of the image are ever resident. Progress goes to
+		 * std::clog from a reporter thread; time a worker spends waiting for the window lowers its utilization.
+		 * Built with RT_ENABLE_STATS, every render entry point ends with a JSON line of ray statistics on std::clog.
+		 */
 		void render(const hittable& world) {
 			initialize();
 
-			std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+			write_ppm_header(std::cout, image_width, image_height);
 
-			for (int j = 0; j < image_height; j++) {
-				std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-				for (int i = 0; i < image_width; i++) {
-					color pixel_color(0,0,0);
-					for (int sample = 0; sample < samples_per_pixel; sample++) {
-						ray r = get_ray(i, j);
-						pixel_color += ray_color(r, max_depth, world);
-					}
-					write_color(std::cout, pixel_samples_scale * pixel_color);
+			const int tiles_x = (image_width + tile_size - 1) / tile_size;
+			const int tiles_y = (image_height + tile_size - 1) / tile_size;
+			ordered_tile_sink sink(image_width, image_height, tile_size, tiles_x, window_rows,
+				[&](int y, const color* row) {
+					write_ppm_row(std::cout, row, image_width, y, dither);
+				});
+
+			const unsigned workers = worker_count(threads);
+			progress_reporter progress(static_cast<std::uint64_t>(image_width) * image_height, workers,
+									   progress_interval, std::clog);
+			render_stats_collector stats;
+			std::atomic<int> next_tile{0};
+			parallel_workers(workers, [&](unsigned worker) {
+				progress.begin_worker(worker);
+				stats.begin_worker();
+				for (int tile = next_tile++; tile < tiles_x * tiles_y; tile = next_tile++) {
+					const int band = tile / tiles_x;
+					const int x0 = (tile % tiles_x) * tile_size;
+					const std::uint64_t rays = render_tile(world, tile_seed(tile), x0, band * tile_size, tile_size,
+														   pixel_samples_scale, sink.begin_band(band) + x0, image_width);
+					progress.add_work(worker, tile_area(x0, band * tile_size), rays);
+					sink.finish_tile(band);
 				}
-			}
-			std::clog << "\rDone.\t\t\t\n";
+				stats.end_worker();
+				progress.end_worker(worker);
+			});
+			progress.finish();
+			stats.report(std::clog);
+		}
+
+		/*
+		 * Parallel tiled render into a framebuffer, whatever its backend and pixel format: tiles follow the framebuffer's
+		 * tiling, are rendered into a per-worker color tile and stored once finished, then released, so file-backed
+		 * framebuffers keep only active tiles resident. Returns false if the framebuffer is not output_height() x
+		 * image_width.
+		 */
+		bool render(const hittable& world, framebuffer& fb) {
+			initialize();
+			if (fb.width() != image_width || fb.height() != image_height) return false;
+
+			const unsigned workers = worker_count(threads);
+			progress_reporter progress(fb.pixel_count(), workers, progress_interval, std::clog);
+			render_stats_collector stats;
+			std::atomic<int> next_tile{0};
+			parallel_workers(workers, [&](unsigned worker) {
+				progress.begin_worker(worker);
+				stats.begin_worker();
+				std::vector<color> pixels(fb.tile_pixels());
+				for (int tile = next_tile++; tile < fb.tile_count(); tile = next_tile++) {
+					const std::uint64_t rays = render_tile(world, tile_seed(tile), fb.tile_x0(tile), fb.tile_y0(tile),
+														   fb.tile_size(), pixel_samples_scale, pixels.data(),
+														   fb.tile_size());
+					fb.store_tile(tile, pixels.data());
+					fb.release_tile(tile);
+					progress.add_work(worker, static_cast<std::uint64_t>(fb.tile_width(tile)) * fb.tile_height(tile),
+									  rays);
+				}
+				stats.end_worker();
+				progress.end_worker(worker);
+			});
+			progress.finish();
+			stats.report(std::clog);
+			return true;
+		}
+
+		/*
+		 * Renders one progressive pass of samples_per_pixel samples per pixel and adds it to `acc`. Passes with different
+		 * numbers draw different samples, so calls with passes 0, 1, 2, ... (on one machine or several, merged later)
+		 * converge like a single render with that many more samples. Returns false if `acc` does not match the image.
+		 */
+		bool accumulate(const hittable& world, accumulation_buffer& acc, std::uint64_t pass) {
+			return accumulate(world, acc, pass, 1);
+		}
+
+		/*
+		 * Renders `passes` progressive passes, numbered first_pass onwards, into `acc` as one job with one progress
+		 * report and one statistics summary. Workers start on the next pass's tiles while the current pass finishes;
+		 * only a tile whose previous pass is still being added waits, as a tile takes one writer at a time.
+		 */
+		bool accumulate(const hittable& world, accumulation_buffer& acc, std::uint64_t first_pass, int passes) {
+			initialize();
+			if (acc.width() != image_width || acc.height() != image_height) return false;
+			if (passes <= 0) return true;
+
+			const int tiles = acc.tile_count();
+			const std::int64_t jobs = static_cast<std::int64_t>(tiles) * passes;
+			const unsigned workers = worker_count(threads);
+			progress_reporter progress(acc.pixel_count() * passes, workers, progress_interval, std::clog);
+			render_stats_collector stats;
+			std::vector<std::atomic<int>> passes_added(tiles);
+			std::atomic<std::int64_t> next_job{0};
+			parallel_workers(workers, [&](unsigned worker) {
+				progress.begin_worker(worker);
+				stats.begin_worker();
+				std::vector<color> pixels(acc.tile_pixels());
+				for (std::int64_t job = next_job++; job < jobs; job = next_job++) {
+					const int tile = static_cast<int>(job % tiles);
+					const int pass = static_cast<int>(job / tiles);
+					const std::uint64_t rays = render_tile(world, tile_seed(tile, first_pass + pass), acc.tile_x0(tile),
+														   acc.tile_y0(tile), acc.tile_size(), 1.0, pixels.data(),
+														   acc.tile_size());
+					// Only when there are fewer tiles than workers can the previous pass still be in progress.
+					while (passes_added[tile].load(std::memory_order_acquire) < pass) std::this_thread::yield();
+					acc.add_tile(tile, pixels.data(), static_cast<std::uint64_t>(samples_per_pixel));
+					passes_added[tile].store(pass + 1, std::memory_order_release);
+					progress.add_work(worker, static_cast<std::uint64_t>(acc.tile_width(tile)) * acc.tile_height(tile),
+									  rays);
+				}
+				stats.end_worker();
+				progress.end_worker(worker);
+			});
+			progress.finish();
+			stats.report(std::clog);
+			return true;
 		}
 };
 
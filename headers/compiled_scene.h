@@ -0,0 +1,255 @@
+#ifndef COMPILED_SCENE_H
+#define COMPILED_SCENE_H
+
+#include "rtweekend.h"
+#include "aligned_allocator.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sphere.h"
+
+#include <cstdint>        // For fixed-width material indices.
+#include <unordered_map>  // For material deduplication by identity during compilation.
+#include <vector>         // For the material table and fallback object list.
+
+/*
+ * Read-only view of SoA sphere arrays, owned by a sphere_soa or by a mapped file.
+ */
+struct sphere_view {
+    const double* center_x;
+    const double* center_y;
+    const double* center_z;
+    const double* radius;
+    const std::uint32_t* material_id;
+    std::size_t count;
+
+    std::size_t size() const { return count; }
+
+    point3 center(std::size_t i) const { return point3(center_x[i], center_y[i], center_z[i]); }
+
+    // Builds the full record for element i at distance t; split out so traversal defers it to the final closest hit.
+    void fill_record(const ray& r, std::size_t i, double t, const std::vector<shared_ptr<material>>& materials,
+                     hit_record& rec) const {
+        rec.t = t;
+        rec.p = r.at(t);
+        vec3 outward_normal = (rec.p - center(i)) / radius[i];
+        rec.set_face_normal(r, outward_normal);
+        rec.mat = materials[material_id[i]];
+    }
+
+    /*
+     * Ray/sphere root for element i.
+     * Same half-b quadratic as sphere::hit so compiled and object scenes produce identical images; a = |dir|^2 is passed
+     * in because it is constant across every sphere a ray is tested against.
+     */
+    bool intersect(std::size_t i, const point3& origin, const vec3& dir, double a, interval ray_t, double& t) const {
+        RT_STAT(intersection_tests);
+        double ocx = center_x[i] - origin.x();
+        double ocy = center_y[i] - origin.y();
+        double ocz = center_z[i] - origin.z();
+        double h = dir.x() * ocx + dir.y() * ocy + dir.z() * ocz;
+        double c = ocx * ocx + ocy * ocy + ocz * ocz - radius[i] * radius[i];
+        double discriminant = h * h - a * c;
+        if (discriminant < 0) {
+            return false;
+        }
+        double sqrtd = std::sqrt(discriminant);
+        double root = (h - sqrtd) / a;
+        if (!ray_t.surrounds(root)) {
+            root = (h + sqrtd) / a;
+            if (!ray_t.surrounds(root)) {
+                return false;
+            }
+        }
+        t = root;
+        return true;
+    }
+};
+
+/*
+ * Structure-of-arrays sphere storage.
+ * One aligned array per field so intersection loops stream only the data they test instead of whole sphere objects.
+ */
+struct sphere_soa {
+    aligned_vector<double> center_x, center_y, center_z, radius;
+    aligned_vector<std::uint32_t> material_id;  // Index into the owning scene's material table
+
+    std::size_t size() const { return radius.size(); }
+
+    void reserve(std::size_t n) {
+        center_x.reserve(n);
+        center_y.reserve(n);
+        center_z.reserve(n);
+        radius.reserve(n);
+        material_id.reserve(n);
+    }
+
+    void push_back(const point3& center, double r, std::uint32_t material_index) {
+        center_x.push_back(center.x());
+        center_y.push_back(center.y());
+        center_z.push_back(center.z());
+        radius.push_back(r);
+        material_id.push_back(material_index);
+    }
+
+    point3 center(std::size_t i) const { return point3(center_x[i], center_y[i], center_z[i]); }
+
+    aabb bounds(std::size_t i) const {
+        auto rvec = vec3(radius[i], radius[i], radius[i]);
+        return aabb(center(i) - rvec, center(i) + rvec);
+    }
+
+    // Copies element i of another array onto the end; used when builders reorder primitives.
+    void push_back_from(const sphere_soa& other, std::size_t i) {
+        push_back(other.center(i), other.radius[i], other.material_id[i]);
+    }
+
+    // In-place edits for structures that update instead of rebuilding.
+    void set(std::size_t i, const point3& center, double r) {
+        center_x[i] = center.x();
+        center_y[i] = center.y();
+        center_z[i] = center.z();
+        radius[i] = r;
+    }
+
+    void set_from(std::size_t i, const sphere_soa& other, std::size_t j) {
+        set(i, other.center(j), other.radius[j]);
+        material_id[i] = other.material_id[j];
+    }
+
+    void insert(std::size_t i, const point3& center, double r, std::uint32_t material_index) {
+        center_x.insert(center_x.begin() + i, center.x());
+        center_y.insert(center_y.begin() + i, center.y());
+        center_z.insert(center_z.begin() + i, center.z());
+        radius.insert(radius.begin() + i, r);
+        material_id.insert(material_id.begin() + i, material_index);
+    }
+
+    // Bulk copy of a view, e.g. out of a mapped scene file.
+    void assign(const sphere_view& v) {
+        center_x.assign(v.center_x, v.center_x + v.count);
+        center_y.assign(v.center_y, v.center_y + v.count);
+        center_z.assign(v.center_z, v.center_z + v.count);
+        radius.assign(v.radius, v.radius + v.count);
+        material_id.assign(v.material_id, v.material_id + v.count);
+    }
+
+    // Non-owning view of the arrays; intersection code runs on views so mapped files can be traced in place.
+    sphere_view view() const {
+        return {center_x.data(), center_y.data(), center_z.data(), radius.data(), material_id.data(), size()};
+    }
+
+    void fill_record(const ray& r, std::size_t i, double t, const std::vector<shared_ptr<material>>& materials,
+                     hit_record& rec) const {
+        view().fill_record(r, i, t, materials, rec);
+    }
+
+    bool intersect(std::size_t i, const point3& origin, const vec3& dir, double a, interval ray_t, double& t) const {
+        return view().intersect(i, origin, dir, a, ray_t, t);
+    }
+};
+
+/*
+ * Compiled, immutable scene.
+ * Produced once from a built hittable_list: nested lists are flattened, spheres are copied into SoA arrays and materials
+ * are deduplicated into a table indexed by 32-bit ids. The closest-hit loop then touches contiguous arrays only and
+ * fills a hit_record once, for the winning primitive, instead of once per closer hit.
+ * Hittables of unknown type are kept as objects and tested after the spheres.
+ */
+class compiled_scene : public hittable {
+private:
+    sphere_soa sphere_data;
+    std::vector<shared_ptr<material>> material_table;
+    std::vector<shared_ptr<hittable>> other_objects;
+    aabb bbox;
+
+    void flatten(const hittable_list& list, std::unordered_map<const material*, std::uint32_t>& material_ids) {
+        for (const auto& object : list.objects) {
+            if (auto nested = dynamic_cast<const hittable_list*>(object.get())) {
+                flatten(*nested, material_ids);
+            } else if (auto s = dynamic_cast<const sphere*>(object.get())) {
+                sphere_data.push_back(s->get_center(), s->get_radius(), intern(s->get_material(), material_ids));
+            } else {
+                other_objects.push_back(object);
+            }
+        }
+    }
+
+    std::uint32_t intern(const shared_ptr<material>& mat,
+                         std::unordered_map<const material*, std::uint32_t>& material_ids) {
+        auto [it, inserted] = material_ids.try_emplace(mat.get(), static_cast<std::uint32_t>(material_table.size()));
+        if (inserted) {
+            material_table.push_back(mat);
+        }
+        return it->second;
+    }
+
+public:
+    explicit compiled_scene(const hittable_list& world) {
+        std::unordered_map<const material*, std::uint32_t> material_ids;
+        sphere_data.reserve(world.objects.size());
+        flatten(world, material_ids);
+        bbox = world.bounding_box();
+    }
+
+    // Spheres-only scene from ready-made arrays, e.g. a mapped scene file; material ids index `materials`.
+    compiled_scene(const sphere_view& spheres, std::vector<shared_ptr<material>> materials)
+        : material_table(std::move(materials)) {
+        sphere_data.assign(spheres);
+        for (std::size_t i = 0; i < sphere_data.size(); i++) bbox = aabb(bbox, sphere_data.bounds(i));
+    }
+
+    const sphere_soa& spheres() const { return sphere_data; }
+    const std::vector<shared_ptr<material>>& materials() const { return material_table; }
+    const std::vector<shared_ptr<hittable>>& others() const { return other_objects; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        const point3& origin = r.origin();
+        const vec3 dir = r.direction();
+        const double a = dir.length_squared();
+
+        double closest_so_far = ray_t.max;
+        std::size_t closest = sphere_data.size();
+        for (std::size_t i = 0; i < sphere_data.size(); i++) {
+            double t;
+            if (sphere_data.intersect(i, origin, dir, a, interval(ray_t.min, closest_so_far), t)) {
+                closest_so_far = t;
+                closest = i;
+            }
+        }
+
+        bool hit_anything = closest < sphere_data.size();
+        if (hit_anything) {
+            sphere_data.fill_record(r, closest, closest_so_far, material_table, rec);
+        }
+
+        hit_record temp_rec;
+        for (const auto& object : other_objects) {
+            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+                hit_anything = true;
+                closest_so_far = temp_rec.t;
+                rec = temp_rec;
+            }
+        }
+
+        return hit_anything;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        const point3& origin = r.origin();
+        const vec3 dir = r.direction();
+        const double a = dir.length_squared();
+
+        for (std::size_t i = 0; i < sphere_data.size(); i++) {
+            double t;
+            if (sphere_data.intersect(i, origin, dir, a, ray_t, t)) return true;
+        }
+        for (const auto& object : other_objects) {
+            if (object->occluded(r, ray_t)) return true;
+        }
+        return false;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+};
+
+#endif
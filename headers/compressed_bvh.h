@@ -0,0 +1,334 @@
+#ifndef COMPRESSED_BVH_H
+#define COMPRESSED_BVH_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "bvh_build.h"
+#include "compiled_scene.h"
+#include "sphere_accelerator.h"
+#include "wide_bvh.h"
+
+#include <algorithm>  // For std::clamp/max/min in quantization.
+#include <cmath>      // For std::floor/ceil/frexp.
+#include <cstdint>    // For packed node fields.
+#include <cstring>    // For building power-of-two scales from bits.
+#include <limits>     // For float infinity.
+#include <vector>     // For subtree ranges and the leaf order.
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Quantized wide BVH node (Ylitie et al., "Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs").
+ * Each node stores a local frame: a float origin at its own box minimum and a power-of-two scale per axis, chosen so 255
+ * steps span the box. Child boxes are 8-bit offsets in that frame, minima rounded down and maxima rounded up, so each
+ * decoded box encloses the exact child box. Interior children are stored contiguously from node_base and the spheres
+ * of all leaf children contiguously from prim_base, so one byte of metadata addresses each slot.
+ * 4-wide nodes take 64 bytes and 8-wide nodes 80 bytes, against 128 and 256 for wide_bvh_node.
+ */
+template <int N>
+struct alignas(16) compressed_wide_node {
+    float origin[3];
+    std::int8_t exponent[3];  // Per-axis scale is 2^exponent
+    std::uint8_t pad;
+    std::uint32_t node_base;  // Index of the first interior child
+    std::uint32_t prim_base;  // First sphere slot of the leaf children
+    std::uint8_t meta[N];     // See the slot encoding below
+    std::uint8_t qmin_x[N], qmin_y[N], qmin_z[N];
+    std::uint8_t qmax_x[N], qmax_y[N], qmax_z[N];
+
+    // Slot encoding: 0xff is empty; high bit set is interior child node_base + (meta & 0x7f); otherwise a leaf batch of
+    // (meta >> 5) + 1 spheres starting at prim_base + (meta & 0x1f).
+    static constexpr std::uint8_t empty_slot = 0xff;
+    static constexpr std::uint8_t interior_flag = 0x80;
+
+    static bool is_empty(std::uint8_t m) { return m == empty_slot; }
+    static bool is_interior(std::uint8_t m) { return m != empty_slot && (m & interior_flag); }
+    static std::uint32_t leaf_count(std::uint8_t m) { return (m >> 5) + 1u; }
+    static std::uint32_t leaf_offset(std::uint8_t m) { return m & 0x1fu; }
+    static std::uint8_t leaf_meta(std::uint32_t count, std::uint32_t offset) {
+        return static_cast<std::uint8_t>(((count - 1) << 5) | offset);
+    }
+
+    // 2^e built from its exponent bits; e stays within the normal float range.
+    static float power_of_two(int e) {
+        std::uint32_t bits = static_cast<std::uint32_t>(e + 127) << 23;
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    float scale(int axis) const { return power_of_two(exponent[axis]); }
+
+    // Decodes one plane. Quantization checks its rounding with this exact expression, so traversal sees the same floats.
+    static float dequantize(float origin, std::uint8_t q, float scale) { return origin + static_cast<float>(q) * scale; }
+
+    // Decodes N planes of one axis; SSE2 widens four bytes at a time, with the same multiply-then-add rounding.
+    static void dequantize_lanes(const std::uint8_t* q, float origin, float scale, float* out) {
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for (int i = 0; i < N; i += 4) {
+            std::int32_t packed;
+            std::memcpy(&packed, q + i, sizeof(packed));
+            __m128i bytes = _mm_cvtsi32_si128(packed);
+            __m128i lanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+            __m128 planes = _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(_mm_cvtepi32_ps(lanes), _mm_set1_ps(scale)));
+            _mm_storeu_ps(out + i, planes);
+        }
+#else
+        for (int i = 0; i < N; i++) out[i] = dequantize(origin, q[i], scale);
+#endif
+    }
+
+    // Expands all child boxes into the float SoA layout that intersect_children() tests. Child links are not copied.
+    void decode(wide_bvh_node<N>& out) const {
+        const float sx = scale(0), sy = scale(1), sz = scale(2);
+        dequantize_lanes(qmin_x, origin[0], sx, out.min_x);
+        dequantize_lanes(qmin_y, origin[1], sy, out.min_y);
+        dequantize_lanes(qmin_z, origin[2], sz, out.min_z);
+        dequantize_lanes(qmax_x, origin[0], sx, out.max_x);
+        dequantize_lanes(qmax_y, origin[1], sy, out.max_y);
+        dequantize_lanes(qmax_z, origin[2], sz, out.max_z);
+    }
+
+    int occupied_mask() const {
+        int mask = 0;
+        for (int i = 0; i < N; i++) mask |= (!is_empty(meta[i])) << i;
+        return mask;
+    }
+
+    void clear() {
+        for (int axis = 0; axis < 3; axis++) {
+            origin[axis] = 0;
+            exponent[axis] = 0;
+        }
+        pad = 0;
+        node_base = prim_base = 0;
+        for (int i = 0; i < N; i++) {
+            meta[i] = empty_slot;
+            qmin_x[i] = qmin_y[i] = qmin_z[i] = 0;
+            qmax_x[i] = qmax_y[i] = qmax_z[i] = 0;
+        }
+    }
+
+    // Places the frame so the 255 quantization steps cover `box` on every axis.
+    void set_frame(const aabb& box) {
+        for (int axis = 0; axis < 3; axis++) {
+            const float lo = round_down_float(box.axis_interval(axis).min);
+            const float hi = round_up_float(box.axis_interval(axis).max);
+            origin[axis] = lo;
+
+            int e;
+            std::frexp((static_cast<double>(hi) - lo) / 255.0, &e);
+            e = std::clamp(e, -126, 126);
+            while (e < 126 && dequantize(lo, 255, power_of_two(e)) < hi) e++;
+            exponent[axis] = static_cast<std::int8_t>(e);
+        }
+    }
+
+    void set_bounds(int slot, const aabb& box) {
+        std::uint8_t* qmin[3] = {qmin_x, qmin_y, qmin_z};
+        std::uint8_t* qmax[3] = {qmax_x, qmax_y, qmax_z};
+        for (int axis = 0; axis < 3; axis++) {
+            const float s = scale(axis);
+            const float lo = round_down_float(box.axis_interval(axis).min);
+            const float hi = round_up_float(box.axis_interval(axis).max);
+
+            int q0 = std::clamp(static_cast<int>(std::floor((static_cast<double>(lo) - origin[axis]) / s)), 0, 255);
+            while (q0 > 0 && dequantize(origin[axis], static_cast<std::uint8_t>(q0), s) > lo) q0--;
+            int q1 = std::clamp(static_cast<int>(std::ceil((static_cast<double>(hi) - origin[axis]) / s)), 0, 255);
+            while (q1 < 255 && dequantize(origin[axis], static_cast<std::uint8_t>(q1), s) < hi) q1++;
+
+            qmin[axis][slot] = static_cast<std::uint8_t>(q0);
+            qmax[axis][slot] = static_cast<std::uint8_t>(q1);
+        }
+    }
+};
+
+static_assert(sizeof(compressed_wide_node<4>) == 64, "compressed 4-wide node must stay 64 bytes");
+static_assert(sizeof(compressed_wide_node<8>) == 80, "compressed 8-wide node must stay 80 bytes");
+
+/*
+ * Compressed wide BVH.
+ * Same collapse and traversal order as wide_bvh, over quantized nodes: each visited node is decoded to floats and tested
+ * with the shared SIMD child test. Spheres are reordered once more after collapsing so each node's leaf batches are
+ * adjacent. Trades a few multiply-adds per node for a 2-3x smaller node array, which matters once the tree no longer
+ * fits in cache.
+ */
+template <int N>
+class compressed_wide_bvh : public sphere_accelerator {
+    static_assert(N == 4 || N == 8, "compressed_wide_bvh supports 4- and 8-wide nodes");
+    static_assert((N - 1) * wide_leaf_batch < 32 && wide_leaf_batch <= 4, "leaf batches must fit the slot encoding");
+
+private:
+    using node_type = compressed_wide_node<N>;
+
+    aligned_vector<node_type> nodes;
+
+    static constexpr int stack_size = 128 * N;
+
+    // Fills node `out` from build node `index`, appending leaf spheres (as current slots) to `order`.
+    void emit(const bvh_build_tree& tree, const std::vector<subtree_range>& ranges, std::uint32_t index,
+              std::uint32_t out, std::vector<std::uint32_t>& order) {
+        std::uint32_t kids[N];
+        const int kid_count = gather_wide_children<N>(tree, ranges, index, kids);
+
+        node_type& node = nodes[out];
+        node.clear();
+        node.set_frame(tree.nodes[index].bbox);
+        node.prim_base = static_cast<std::uint32_t>(order.size());
+
+        std::uint32_t interior[N];
+        int interior_count = 0;
+        for (int k = 0; k < kid_count; k++) {
+            node.set_bounds(k, tree.nodes[kids[k]].bbox);
+            if (is_leaf_batch(tree, ranges, kids[k])) {
+                const subtree_range range = ranges[kids[k]];
+                node.meta[k] = node_type::leaf_meta(range.count, static_cast<std::uint32_t>(order.size()) - node.prim_base);
+                for (std::uint32_t i = range.first; i < range.first + range.count; i++) order.push_back(i);
+            } else {
+                node.meta[k] = static_cast<std::uint8_t>(node_type::interior_flag | interior_count);
+                interior[interior_count++] = kids[k];
+            }
+        }
+
+        const std::uint32_t base = static_cast<std::uint32_t>(nodes.size());
+        nodes[out].node_base = base;  // `node` is invalidated by the resize below
+        nodes.resize(base + interior_count);
+        for (int j = 0; j < interior_count; j++) emit(tree, ranges, interior[j], base + j, order);
+    }
+
+    template <bool CollectStats, bool AnyHit = false>
+    std::size_t traverse(const ray& r, interval ray_t, double& closest_so_far, bvh_traversal_stats* stats) const {
+        const point3& origin = r.origin();
+        const vec3 dir = r.direction();
+        const double a = dir.length_squared();
+        const wide_ray wr(r);
+        const float t_min = round_down_float(ray_t.min);
+
+        std::size_t closest = sphere_data.size();
+        if (nodes.empty()) return closest;
+        if constexpr (CollectStats) stats->rays++;
+
+        struct entry {
+            std::uint32_t node;
+            float t_near;
+        };
+        entry stack[stack_size];
+        int top = 0;
+        stack[top++] = {0, -std::numeric_limits<float>::infinity()};
+
+        wide_bvh_node<N> decoded;
+        while (top > 0) {
+            const entry e = stack[--top];
+            if (e.t_near > closest_so_far) continue;
+
+            const node_type& node = nodes[e.node];
+            if constexpr (CollectStats) stats->nodes_visited++;
+
+            node.decode(decoded);
+            float t_near[N];
+            int mask = intersect_children(decoded, wr, t_min, round_up_float(closest_so_far), t_near);
+            mask &= node.occupied_mask();
+            if (mask == 0) continue;
+
+            // Order the hit children nearest-first (insertion sort over at most N entries).
+            int order[N];
+            int hits = 0;
+            for (int i = 0; i < N; i++) {
+                if (!(mask & (1 << i))) continue;
+                int j = hits++;
+                while (j > 0 && t_near[order[j - 1]] > t_near[i]) {
+                    order[j] = order[j - 1];
+                    j--;
+                }
+                order[j] = i;
+            }
+
+            // Leaf batches are tested in order right away; interior children are pushed farthest-first.
+            for (int h = 0; h < hits; h++) {
+                const int slot = order[h];
+                const std::uint8_t m = node.meta[slot];
+                if (node_type::is_interior(m) || t_near[slot] > closest_so_far) continue;
+                const std::uint32_t first = node.prim_base + node_type::leaf_offset(m);
+                const std::uint32_t count = node_type::leaf_count(m);
+                if constexpr (CollectStats) {
+                    stats->leaves_visited++;
+                    stats->primitive_tests += count;
+                }
+                for (std::uint32_t i = first; i < first + count; i++) {
+                    double t;
+                    if (sphere_data.intersect(i, origin, dir, a, interval(ray_t.min, closest_so_far), t)) {
+                        closest_so_far = t;
+                        closest = i;
+                        if constexpr (AnyHit) return closest;
+                    }
+                }
+            }
+            for (int h = hits - 1; h >= 0; h--) {
+                const int slot = order[h];
+                const std::uint8_t m = node.meta[slot];
+                if (node_type::is_interior(m)) stack[top++] = {node.node_base + (m & 0x7fu), t_near[slot]};
+            }
+        }
+        return closest;
+    }
+
+public:
+    explicit compressed_wide_bvh(const compiled_scene& scene, bvh_builder builder = bvh_builder::binned_sah,
+                                 unsigned threads = 0, int sah_bins = 32)
+        : sphere_accelerator(scene) {
+        bvh_build_tree tree = build_tree(scene, builder, threads, sah_bins);
+        if (tree.nodes.empty()) return;
+
+        std::vector<subtree_range> ranges(tree.nodes.size());
+        compute_subtree_ranges(tree, tree.root, ranges);
+        nodes.reserve(tree.nodes.size() / (N - 1) + 1);
+        nodes.emplace_back();
+
+        std::vector<std::uint32_t> order;
+        order.reserve(sphere_data.size());
+        emit(tree, ranges, tree.root, 0, order);
+
+        // Move the spheres into the per-node leaf order produced by emit().
+        sphere_soa reordered;
+        std::vector<std::uint32_t> reordered_ids;
+        reordered.reserve(order.size());
+        reordered_ids.reserve(order.size());
+        for (auto slot : order) {
+            reordered.push_back_from(sphere_data, slot);
+            reordered_ids.push_back(prim_ids[slot]);
+        }
+        sphere_data = std::move(reordered);
+        prim_ids = std::move(reordered_ids);
+    }
+
+    std::size_t node_count() const { return nodes.size(); }
+    std::size_t node_bytes() const { return nodes.size() * sizeof(node_type); }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return hit_with_stats(r, ray_t, rec, nullptr);
+    }
+
+    // Closest hit, optionally accumulating traversal counts; nodes_visited counts wide nodes (N box tests each).
+    bool hit_with_stats(const ray& r, interval ray_t, hit_record& rec, bvh_traversal_stats* stats) const {
+        double closest_so_far = ray_t.max;
+        std::size_t closest = stats ? traverse<true>(r, ray_t, closest_so_far, stats)
+                                    : traverse<false>(r, ray_t, closest_so_far, nullptr);
+        return finish_hit(r, ray_t, closest, closest_so_far, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        double closest_so_far = ray_t.max;
+        return traverse<false, true>(r, ray_t, closest_so_far, nullptr) < sphere_data.size() ||
+               others_occluded(other_objects, r, ray_t);
+    }
+};
+
+using compressed_qbvh = compressed_wide_bvh<4>;
+using compressed_obvh = compressed_wide_bvh<8>;
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef DYNAMIC_BVH_H
+#define DYNAMIC_BVH_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "bvh_build.h"
+#include "compiled_scene.h"
+
+#include <algorithm>      // For std::sort and range bounds.
+#include <cstdint>        // For node links and primitive ids.
+#include <limits>         // For empty slot ranges.
+#include <unordered_map>  // For material lookup on insert.
+#include <vector>         // For areas, slot maps and rebuild lists.
+
+// What dynamic_bvh::maintain() did to restore tree quality.
+enum class bvh_update { none, partial, full };
+
+/*
+ * BVH for animated scenes.
+ * Spheres are moved in place with update_sphere() and the boxes brought back up to date with refit(), a single
+ * reverse pass over the depth-first node array (children always follow their parent). Refitting keeps the topology, so
+ * quality decays as spheres drift; maintain() compares the SAH cost against the cost at the last full build and, past
+ * the threshold, rebuilds the smallest subtrees that still contain each degraded region, falling back to a full
+ * rebuild when those cover most of the tree. insert() adds a sphere like hittable_list::add, descending to the leaf
+ * whose subtree grows least and splitting it when it overflows; a split that would take the tree deeper than
+ * traversal's fixed stack rebuilds the whole tree instead. Insertion keeps the depth-first layout by shifting the
+ * arrays behind the new slot and node, so it is linear in the scene size: meant for a handful of spheres per frame.
+ */
+class dynamic_bvh : public bvh {
+private:
+    std::vector<double> reference_area;  // Surface area of each node when it was last built
+    std::vector<std::uint32_t> slot_of;  // Primitive id -> sphere slot
+    std::unordered_map<const material*, std::uint32_t> material_ids;  // Material -> index in material_table
+    double reference_cost = 0;
+
+    // Construction settings, reused by every partial and full rebuild.
+    bvh_builder builder;
+    unsigned build_threads;
+    int sah_bins;
+
+    static constexpr std::uint32_t max_leaf_size = 4;
+
+    void index_slots() {
+        slot_of.assign(prim_ids.size(), 0);
+        for (std::size_t slot = 0; slot < prim_ids.size(); slot++) slot_of[prim_ids[slot]] = static_cast<std::uint32_t>(slot);
+    }
+
+    void set_reference_area(std::uint32_t i) { reference_area[i] = nodes[i].bounds().surface_area(); }
+
+    // One past the last node of the subtree at i: the depth-first layout ends every subtree with its last second child.
+    std::uint32_t subtree_end(std::uint32_t i) const {
+        while (!nodes[i].is_leaf()) i = nodes[i].offset;
+        return i + 1;
+    }
+
+    aabb leaf_bounds(const bvh_node& node) const {
+        aabb box = aabb::empty;
+        for (std::uint32_t s = node.offset; s < node.offset + node.count; s++) box = aabb(box, sphere_data.bounds(s));
+        return box;
+    }
+
+    void fit_node(std::uint32_t i) {
+        bvh_node& node = nodes[i];
+        node.set_bounds(node.is_leaf() ? leaf_bounds(node) : aabb(nodes[i + 1].bounds(), nodes[node.offset].bounds()));
+    }
+
+    void update_bounding_box() {
+        bbox = nodes.empty() ? aabb::empty : nodes[0].bounds();
+        for (const auto& object : other_objects) bbox = aabb(bbox, object->bounding_box());
+    }
+
+    // Shifts links to nodes at or after `position` by `delta`, for a node range about to be resized there.
+    void shift_node_links(std::uint32_t position, std::int64_t delta) {
+        for (auto& node : nodes) {
+            if (!node.is_leaf() && node.offset >= position) node.offset = static_cast<std::uint32_t>(node.offset + delta);
+        }
+    }
+
+    // Shifts leaf ranges starting at or after slot `position` by `delta`, except the leaf at `skip`.
+    void shift_leaf_slots(std::uint32_t position, std::int64_t delta, std::uint32_t skip) {
+        for (std::uint32_t i = 0; i < nodes.size(); i++) {
+            if (i != skip && nodes[i].is_leaf() && nodes[i].offset >= position) {
+                nodes[i].offset = static_cast<std::uint32_t>(nodes[i].offset + delta);
+            }
+        }
+    }
+
+    // Rebuilds the subtree at `root` over its own spheres with the constructor's builder and splices the result in
+    // place; ancestors keep their boxes until the next refit().
+    void rebuild_subtree(std::uint32_t root) {
+        const std::uint32_t end = subtree_end(root);
+        std::uint32_t first = std::numeric_limits<std::uint32_t>::max(), last = 0;
+        for (std::uint32_t i = root; i < end; i++) {
+            if (!nodes[i].is_leaf()) continue;
+            first = std::min(first, nodes[i].offset);
+            last = std::max(last, nodes[i].offset + nodes[i].count);
+        }
+
+        std::vector<aabb> bounds(last - first);
+        for (std::uint32_t k = 0; k < bounds.size(); k++) bounds[k] = sphere_data.bounds(first + k);
+        bvh_build_tree tree = build_bvh_tree(bounds, builder, build_threads, sah_bins);
+
+        // Move the subtree's spheres into the new leaf order; the slot range itself does not change.
+        sphere_soa moved;
+        std::vector<std::uint32_t> moved_ids;
+        moved.reserve(bounds.size());
+        for (auto k : tree.prim_order) {
+            moved.push_back_from(sphere_data, first + k);
+            moved_ids.push_back(prim_ids[first + k]);
+        }
+        for (std::uint32_t k = 0; k < moved.size(); k++) {
+            sphere_data.set_from(first + k, moved, k);
+            prim_ids[first + k] = moved_ids[k];
+            slot_of[moved_ids[k]] = first + k;
+        }
+
+        aligned_vector<bvh_node> replacement;
+        replacement.reserve(tree.nodes.size());
+        flatten_bvh(tree, tree.root, replacement);
+        for (auto& node : replacement) node.offset += node.is_leaf() ? first : root;
+
+        const std::uint32_t old_count = end - root;
+        shift_node_links(end, static_cast<std::int64_t>(replacement.size()) - old_count);
+        nodes.erase(nodes.begin() + root, nodes.begin() + end);
+        nodes.insert(nodes.begin() + root, replacement.begin(), replacement.end());
+        reference_area.erase(reference_area.begin() + root, reference_area.begin() + end);
+        reference_area.insert(reference_area.begin() + root, replacement.size(), 0.0);
+        for (std::uint32_t i = root; i < root + replacement.size(); i++) set_reference_area(i);
+    }
+
+    void rebuild_all() {
+        rebuild_subtree(0);
+        update_bounding_box();
+        reference_cost = sah_cost();
+    }
+
+    // Turns an overflowing leaf into an interior node over two leaves split at the centroid median.
+    void split_leaf(std::uint32_t leaf) {
+        const std::uint32_t first = nodes[leaf].offset, count = nodes[leaf].count;
+
+        aabb centroids = aabb::empty;
+        for (std::uint32_t s = first; s < first + count; s++) {
+            point3 c = sphere_data.center(s);
+            centroids = aabb(centroids, aabb(c, c));
+        }
+        const int axis = centroids.longest_axis();
+
+        std::vector<std::uint32_t> order(count);
+        for (std::uint32_t k = 0; k < count; k++) order[k] = first + k;
+        std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return sphere_data.center(a)[axis] < sphere_data.center(b)[axis];
+        });
+        sphere_soa sorted;
+        std::vector<std::uint32_t> sorted_ids;
+        for (auto s : order) {
+            sorted.push_back_from(sphere_data, s);
+            sorted_ids.push_back(prim_ids[s]);
+        }
+        for (std::uint32_t k = 0; k < count; k++) {
+            sphere_data.set_from(first + k, sorted, k);
+            prim_ids[first + k] = sorted_ids[k];
+        }
+
+        shift_node_links(leaf + 1, 2);
+        nodes.insert(nodes.begin() + leaf + 1, 2, bvh_node{});
+        reference_area.insert(reference_area.begin() + leaf + 1, 2, 0.0);
+
+        const std::uint32_t half = count / 2;
+        for (std::uint32_t k = 1; k <= 2; k++) {
+            nodes[leaf + k].offset = k == 1 ? first : first + half;
+            nodes[leaf + k].count = static_cast<std::uint16_t>(k == 1 ? half : count - half);
+            nodes[leaf + k].axis = 0;
+            nodes[leaf + k].pad = 0;
+            fit_node(leaf + k);
+            set_reference_area(leaf + k);
+        }
+        nodes[leaf].offset = leaf + 2;
+        nodes[leaf].count = 0;
+        nodes[leaf].axis = static_cast<std::uint8_t>(axis);
+        fit_node(leaf);
+    }
+
+public:
+    explicit dynamic_bvh(const compiled_scene& scene, bvh_builder builder = bvh_builder::binned_sah, unsigned threads = 0,
+                         int sah_bins = 32)
+        : bvh(scene, builder, threads, sah_bins), builder(builder), build_threads(threads), sah_bins(sah_bins) {
+        reference_area.resize(nodes.size());
+        for (std::uint32_t i = 0; i < nodes.size(); i++) set_reference_area(i);
+        index_slots();
+        for (std::uint32_t k = 0; k < material_table.size(); k++) material_ids.try_emplace(material_table[k].get(), k);
+        reference_cost = sah_cost();
+    }
+
+    // Moves or resizes a sphere by primitive id; boxes are stale until refit().
+    void update_sphere(std::uint32_t prim_id, const point3& center, double radius) {
+        sphere_data.set(slot_of[prim_id], center, radius);
+    }
+
+    point3 sphere_center(std::uint32_t prim_id) const { return sphere_data.center(slot_of[prim_id]); }
+    double sphere_radius(std::uint32_t prim_id) const { return sphere_data.radius[slot_of[prim_id]]; }
+
+    // Recomputes every box bottom-up; linear in the node count and free of any sorting or allocation.
+    void refit() {
+        for (std::uint32_t i = static_cast<std::uint32_t>(nodes.size()); i-- > 0;) fit_node(i);
+        update_bounding_box();
+    }
+
+    // Current SAH cost relative to the cost right after the last full build.
+    double degradation() const { return reference_cost > 0 ? sah_cost() / reference_cost : 1; }
+
+    // Call after refit(); rebuilds as much of the tree as needed to bring the SAH cost back within `threshold`.
+    bvh_update maintain(double threshold = 1.3) {
+        if (nodes.empty() || degradation() <= threshold) return bvh_update::none;
+
+        // Find the topmost nodes that grew past the threshold; the parent of each is the smallest subtree that still
+        // holds the spheres that moved out of it.
+        std::vector<std::uint32_t> roots;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pending = {{0, 0}};  // (node, parent)
+        while (!pending.empty()) {
+            auto [i, parent] = pending.back();
+            pending.pop_back();
+            if (nodes[i].bounds().surface_area() > threshold * reference_area[i]) {
+                roots.push_back(parent);
+            } else if (!nodes[i].is_leaf()) {
+                pending.push_back({i + 1, i});
+                pending.push_back({nodes[i].offset, i});
+            }
+        }
+
+        // Drop subtrees nested in another one, then rebuild back to front so splices never move pending roots.
+        std::sort(roots.begin(), roots.end());
+        std::vector<std::uint32_t> disjoint;
+        std::uint32_t covered_end = 0;
+        std::size_t covered_nodes = 0;
+        for (auto r : roots) {
+            if (!disjoint.empty() && r < covered_end) continue;
+            disjoint.push_back(r);
+            covered_end = subtree_end(r);
+            covered_nodes += covered_end - r;
+        }
+
+        if (disjoint.empty() || disjoint.front() == 0 || covered_nodes * 2 > nodes.size()) {
+            rebuild_all();
+            return bvh_update::full;
+        }
+        for (auto it = disjoint.rbegin(); it != disjoint.rend(); ++it) rebuild_subtree(*it);
+        refit();
+        if (degradation() > threshold) {
+            rebuild_all();
+            return bvh_update::full;
+        }
+        return bvh_update::partial;
+    }
+
+    /*
+     * Adds a sphere and returns its primitive id (the next unused one). Descends to the leaf whose path grows least,
+     * inserts the sphere at the end of that leaf's slot range and refits the path; an overflowing leaf is split.
+     */
+    std::uint32_t insert(const point3& center, double radius, shared_ptr<material> mat) {
+        auto [material_entry, new_material] =
+            material_ids.try_emplace(mat.get(), static_cast<std::uint32_t>(material_table.size()));
+        if (new_material) material_table.push_back(std::move(mat));
+        const std::uint32_t material_index = material_entry->second;
+
+        const std::uint32_t id = static_cast<std::uint32_t>(prim_ids.size());
+        const vec3 rvec(radius, radius, radius);
+        const aabb box(center - rvec, center + rvec);
+
+        if (nodes.empty()) {
+            sphere_data.push_back(center, radius, material_index);
+            prim_ids.push_back(id);
+            nodes.emplace_back();
+            nodes[0] = bvh_node{};
+            nodes[0].count = 1;
+            fit_node(0);
+            reference_area.assign(1, 0.0);
+            set_reference_area(0);
+            index_slots();
+            update_bounding_box();
+            reference_cost = sah_cost();
+            return id;
+        }
+
+        std::vector<std::uint32_t> path;
+        std::uint32_t i = 0;
+        while (!nodes[i].is_leaf()) {
+            path.push_back(i);
+            auto growth = [&](std::uint32_t c) {
+                aabb b = nodes[c].bounds();
+                return aabb(b, box).surface_area() - b.surface_area();
+            };
+            i = growth(i + 1) <= growth(nodes[i].offset) ? i + 1 : nodes[i].offset;
+        }
+
+        const std::uint32_t leaf_first = nodes[i].offset;
+        const std::uint32_t slot = leaf_first + nodes[i].count;
+        sphere_data.insert(slot, center, radius, material_index);
+        prim_ids.insert(prim_ids.begin() + slot, id);
+        shift_leaf_slots(slot, 1, i);
+        nodes[i].count++;
+        slot_of.push_back(0);
+
+        if (nodes[i].count <= max_leaf_size) {
+            fit_node(i);
+        } else if (path.size() + 1 < static_cast<std::size_t>(stack_size)) {
+            split_leaf(i);
+        } else {
+            // Traversal pushes one node per interior level, so a split here could overflow its stack; inserts along a
+            // line descend the same path every time. A full build brings the depth back to what the builders bound.
+            rebuild_all();
+            return id;
+        }
+        for (auto it = path.rbegin(); it != path.rend(); ++it) fit_node(*it);
+
+        // Only slots from the target leaf on have moved.
+        for (std::size_t s = leaf_first; s < prim_ids.size(); s++) slot_of[prim_ids[s]] = static_cast<std::uint32_t>(s);
+        update_bounding_box();
+        return id;
+    }
+};
+
+#endif
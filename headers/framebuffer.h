@@ -0,0 +1,235 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "rtweekend.h"
+#include "aligned_allocator.h"
+#include "pixel_formats.h"
+
+#include <algorithm>  // For std::min.
+#include <cerrno>     // For EOPNOTSUPP.
+#include <cstddef>    // For std::size_t.
+#include <cstdint>    // For the file header.
+#include <cstring>    // For the magic and format name.
+#include <string>     // For file paths.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Tile grid shared by framebuffers and accumulation buffers.
+ * Pixels are stored tile by tile, each tile a tile_size x tile_size row-major block (edge tiles use their top-left
+ * part), so a render thread touches one contiguous region per tile.
+ */
+class tile_layout {
+protected:
+    int image_width;
+    int image_height;
+    int tile_edge;
+    int tiles_across;
+    int tiles_down;
+
+    tile_layout(int width, int height, int tile_size)
+        : image_width(width), image_height(height), tile_edge(tile_size),
+          tiles_across((width + tile_size - 1) / tile_size), tiles_down((height + tile_size - 1) / tile_size) {}
+
+public:
+    int width() const { return image_width; }
+    int height() const { return image_height; }
+    int tile_size() const { return tile_edge; }
+    int tiles_x() const { return tiles_across; }
+    int tiles_y() const { return tiles_down; }
+    int tile_count() const { return tiles_across * tiles_down; }
+    std::size_t tile_pixels() const { return static_cast<std::size_t>(tile_edge) * tile_edge; }
+    std::size_t pixel_count() const { return static_cast<std::size_t>(image_width) * image_height; }
+
+    // Pixels of tile t that lie inside the image.
+    int tile_x0(int t) const { return (t % tiles_across) * tile_edge; }
+    int tile_y0(int t) const { return (t / tiles_across) * tile_edge; }
+    int tile_width(int t) const { return std::min(tile_edge, image_width - tile_x0(t)); }
+    int tile_height(int t) const { return std::min(tile_edge, image_height - tile_y0(t)); }
+};
+
+/*
+ * Tiled framebuffer.
+ * Backends decide where tiles live and in which pixel format; renderers store finished tiles as color and writers
+ * read rows back as color, so neither depends on the storage.
+ */
+class framebuffer : public tile_layout {
+protected:
+    using tile_layout::tile_layout;
+
+public:
+    virtual ~framebuffer() = default;
+
+    // Stores tile t from `pixels`, tile_size apart per row; only the part inside the image is read.
+    virtual void store_tile(int t, const color* pixels) = 0;
+
+    // Gathers image row y (width pixels) into `out`.
+    virtual void read_row(int y, color* out) const = 0;
+
+    // Hint that tile t is not needed for now; file-backed storage may drop it from memory. Contents are unchanged.
+    virtual void release_tile(int) const {}
+
+    // Storage per pixel, and name of the pixel format.
+    virtual std::size_t pixel_bytes() const = 0;
+    virtual const char* format_name() const = 0;
+};
+
+/*
+ * Framebuffer whose tiles hold Format::stored pixels; backends only say where tile t starts.
+ * Conversion happens per tile on store and per row on read, so packed formats cost arithmetic, not extra passes.
+ */
+template <typename Format>
+class packed_framebuffer : public framebuffer {
+public:
+    using format = Format;
+    using stored = typename Format::stored;
+
+protected:
+    using framebuffer::framebuffer;
+
+    virtual stored* tile_data(int t) = 0;
+    virtual const stored* tile_data(int t) const = 0;
+
+public:
+    void store_tile(int t, const color* pixels) override {
+        stored* dst = tile_data(t);
+        const int w = tile_width(t), h = tile_height(t);
+        for (int j = 0; j < h; j++) {
+            const std::size_t row = static_cast<std::size_t>(j) * tile_edge;
+            for (int i = 0; i < w; i++) dst[row + i] = Format::encode(pixels[row + i]);
+        }
+    }
+
+    void read_row(int y, color* out) const override {
+        const int ty = y / tile_edge;
+        const std::size_t row_offset = static_cast<std::size_t>(y % tile_edge) * tile_edge;
+        for (int tx = 0; tx < tiles_across; tx++) {
+            const int t = ty * tiles_across + tx;
+            const stored* src = tile_data(t) + row_offset;
+            color* dst = out + tx * tile_edge;
+            const int w = tile_width(t);
+            for (int i = 0; i < w; i++) dst[i] = Format::decode(src[i]);
+        }
+    }
+
+    std::size_t pixel_bytes() const override { return sizeof(stored); }
+    const char* format_name() const override { return Format::name; }
+};
+
+// Framebuffer held in process memory.
+template <typename Format = rgb64_format>
+class memory_framebuffer : public packed_framebuffer<Format> {
+private:
+    using stored = typename Format::stored;
+    aligned_vector<stored> pixels;
+
+protected:
+    stored* tile_data(int t) override { return &pixels[static_cast<std::size_t>(t) * this->tile_pixels()]; }
+    const stored* tile_data(int t) const override {
+        return &pixels[static_cast<std::size_t>(t) * this->tile_pixels()];
+    }
+
+public:
+    memory_framebuffer(int width, int height, int tile_size = 32)
+        : packed_framebuffer<Format>(width, height, tile_size),
+          pixels(static_cast<std::size_t>(this->tile_count()) * this->tile_pixels()) {}
+
+    std::size_t storage_bytes() const { return pixels.size() * sizeof(stored); }
+};
+
+/*
+ * Framebuffer in a memory-mapped file, for images larger than RAM.
+ * Each tile starts on a page boundary, so only tiles being rendered or read need to be resident: release_tile()
+ * schedules a finished tile for writeback and drops its pages, and the OS pages it back in if it is read again.
+ * The file's blocks are allocated up front, behind a one-page header recording the dimensions and pixel format, so a
+ * full disk makes valid() false instead of raising SIGBUS on a later tile store; file systems that cannot preallocate
+ * get a sparse file. The file is left in place.
+ */
+template <typename Format = rgb64_format>
+class mapped_framebuffer : public packed_framebuffer<Format> {
+private:
+    using stored = typename Format::stored;
+
+    struct file_header {
+        char magic[8];
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t tile_size;
+        std::uint32_t pixel_bytes;
+        std::uint64_t tile_stride;  // Bytes between tile starts
+        char format[8];
+    };
+
+    static constexpr char magic[8] = {'R', 'T', 'F', 'R', 'A', 'M', 'E', '2'};
+
+    unsigned char* base = nullptr;
+    std::size_t length = 0;
+    std::size_t header_bytes = 0;
+    std::size_t tile_stride = 0;
+
+    unsigned char* tile_bytes(int t) const { return base + header_bytes + static_cast<std::size_t>(t) * tile_stride; }
+
+protected:
+    stored* tile_data(int t) override { return reinterpret_cast<stored*>(tile_bytes(t)); }
+    const stored* tile_data(int t) const override { return reinterpret_cast<const stored*>(tile_bytes(t)); }
+
+public:
+    mapped_framebuffer(const std::string& path, int width, int height, int tile_size = 32)
+        : packed_framebuffer<Format>(width, height, tile_size) {
+        const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        header_bytes = page;
+        tile_stride = (this->tile_pixels() * sizeof(stored) + page - 1) / page * page;
+        length = header_bytes + static_cast<std::size_t>(this->tile_count()) * tile_stride;
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return;
+        int allocated = ::posix_fallocate(fd, 0, static_cast<off_t>(length));
+        if (allocated == EOPNOTSUPP) allocated = ::ftruncate(fd, static_cast<off_t>(length));
+        if (allocated == 0) {
+            void* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) base = static_cast<unsigned char*>(p);
+        }
+        ::close(fd);
+        if (!base) return;
+
+        file_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.width = static_cast<std::uint32_t>(width);
+        header.height = static_cast<std::uint32_t>(height);
+        header.tile_size = static_cast<std::uint32_t>(tile_size);
+        header.pixel_bytes = static_cast<std::uint32_t>(sizeof(stored));
+        header.tile_stride = tile_stride;
+        std::strncpy(header.format, Format::name, sizeof(header.format));
+        std::memcpy(base, &header, sizeof(header));
+    }
+
+    ~mapped_framebuffer() override {
+        if (base) ::munmap(base, length);
+    }
+
+    mapped_framebuffer(const mapped_framebuffer&) = delete;
+    mapped_framebuffer& operator=(const mapped_framebuffer&) = delete;
+
+    bool valid() const { return base != nullptr; }
+    std::size_t file_bytes() const { return length; }
+
+    void store_tile(int t, const color* pixels) override {
+        if (base) packed_framebuffer<Format>::store_tile(t, pixels);
+    }
+
+    void read_row(int y, color* out) const override {
+        if (base) packed_framebuffer<Format>::read_row(y, out);
+    }
+
+    void release_tile(int t) const override {
+        if (!base) return;
+        // Dirty pages of a shared file mapping stay in the page cache after MADV_DONTNEED, so nothing is lost.
+        ::msync(tile_bytes(t), tile_stride, MS_ASYNC);
+        ::madvise(tile_bytes(t), tile_stride, MADV_DONTNEED);
+    }
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define HITTABLE_H
 
 #include "rtweekend.h"
+#include "aabb.h"
+#include "render_stats.h"
 
 /*
  * Hit record structure.
@@ -41,6 +43,22 @@ public:
      * Parameterized with t-interval to prune invalid hits early, optimizing for complex scenes and acceleration structures.
      */
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+    /*
+     * Any-hit query.
+     * Answers only whether something lies within the interval, so shadow and visibility rays can stop at the first
+     * intersection and skip building a record. The default falls back to a closest-hit query.
+     */
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(r, ray_t, rec);
+    }
+
+    /*
+     * World-space bounds.
+     * Required so any hittable can be placed under an acceleration structure.
+     */
+    virtual aabb bounding_box() const = 0;
 };
 
 #endif
@@ -14,6 +14,7 @@
 class hittable_list : public hittable {
 public:
     std::vector<std::shared_ptr<hittable>> objects;
+    aabb bbox;  // Running union of object bounds, maintained by add()
 
     // Default constructor for empty lists; supports incremental building via add().
     hittable_list() {}
@@ -22,13 +23,21 @@ public:
     hittable_list(std::shared_ptr<hittable> object) { add(object); }
 
     // Clear method; provided for reusability and scene resetting without recreating the list.
-    void clear() { objects.clear(); }
+    void clear() {
+        objects.clear();
+        bbox = aabb();
+    }
 
     // Add method; appends to vector for O(1) amortized time, suitable for large scenes.
+    // Arena-owned objects (see scene_arena::make) arrive as control-block-free pointers, so no ownership is taken.
     void add(std::shared_ptr<hittable> object) {
-        objects.push_back(object);
+        bbox = aabb(bbox, object->bounding_box());
+        objects.push_back(std::move(object));
     }
 
+    // Reserve method; sizes the pointer array once when the object count is known up front.
+    void reserve(std::size_t count) { objects.reserve(count); }
+
     /*
      * Override for collective hit testing.
      * Iterates sequentially for simplicity; designed for extension to acceleration structures like BVH in performance-critical evolutions.
@@ -48,6 +57,16 @@ public:
 
         return hit_anything;
     }
+
+    // Any-hit: the first object that reports an intersection ends the query.
+    bool occluded(const ray& r, interval ray_t) const override {
+        for (const auto& object : objects) {
+            if (object->occluded(r, ray_t)) return true;
+        }
+        return false;
+    }
+
+    aabb bounding_box() const override { return bbox; }
 };
 
 #endif
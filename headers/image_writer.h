@@ -0,0 +1,180 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "rtweekend.h"
+#include "framebuffer.h"
+#include "png_encoder.h"
+#include "quantize.h"
+
+#include <algorithm>  // For std::max.
+#include <cmath>      // For frexp in RGBE.
+#include <cstdint>    // For byte buffers.
+#include <cstring>    // For float bytes and the endianness probe.
+#include <ostream>    // For the output stream.
+#include <string>     // For format names.
+#include <vector>     // For the row buffer.
+
+/*
+ * Image writers.
+ * Work row by row, from a streamed row or from any framebuffer backend, so a whole image never has to be resident.
+ * PPM is gamma-corrected 8-bit; PFM and Radiance HDR keep linear radiance, so tone mapping and compositing can be
+ * redone later without rendering again.
+ */
+
+enum class row_order { top_down, bottom_up };
+
+inline void write_ppm_header(std::ostream& out, int width, int height) {
+    out << "P3\n" << width << ' ' << height << "\n255\n";
+}
+
+// One row of plain PPM text, byte-for-byte what write_color prints per pixel, from the vectorized quantizer.
+inline void write_ppm_row(std::ostream& out, const color* row, int width, int y = 0,
+                          dither_mode dither = dither_mode::none) {
+    // Decimal text of every byte value, padded to four characters, with its length.
+    struct decimal {
+        char digits[4];
+        int length;
+    };
+    static const auto decimals = [] {
+        std::vector<decimal> table(256);
+        for (int v = 0; v < 256; v++) {
+            const std::string text = std::to_string(v);
+            std::memcpy(table[v].digits, text.data(), text.size());
+            table[v].length = static_cast<int>(text.size());
+        }
+        return table;
+    }();
+
+    std::vector<unsigned char> bytes(static_cast<std::size_t>(width) * 3);
+    quantize_row(row, width, bytes.data(), y, dither);
+
+    std::vector<char> text(bytes.size() * 4 + 4);
+    char* p = text.data();
+    for (std::size_t k = 0; k < bytes.size(); k++) {
+        const decimal& d = decimals[bytes[k]];
+        std::memcpy(p, d.digits, 4);
+        p += d.length;
+        *p++ = k % 3 == 2 ? '\n' : ' ';
+    }
+    out.write(text.data(), p - text.data());
+}
+
+// Releases each row of tiles once its last image row has been read, so readers of large framebuffers stay out of core.
+template <typename F>
+void for_each_row(const framebuffer& fb, F&& body, row_order order = row_order::top_down) {
+    std::vector<color> row(fb.width());
+    for (int k = 0; k < fb.height(); k++) {
+        const int y = order == row_order::top_down ? k : fb.height() - 1 - k;
+        fb.read_row(y, row.data());
+        body(y, row.data());
+        const bool tile_row_done = order == row_order::top_down
+            ? (y + 1) % fb.tile_size() == 0 || y + 1 == fb.height()
+            : y % fb.tile_size() == 0;
+        if (tile_row_done) {
+            const int ty = y / fb.tile_size();
+            for (int tx = 0; tx < fb.tiles_x(); tx++) fb.release_tile(ty * fb.tiles_x() + tx);
+        }
+    }
+}
+
+// Plain PPM of a whole framebuffer.
+inline void write_ppm(std::ostream& out, const framebuffer& fb, dither_mode dither = dither_mode::none) {
+    write_ppm_header(out, fb.width(), fb.height());
+    for_each_row(fb, [&](int y, const color* row) { write_ppm_row(out, row, fb.width(), y, dither); });
+}
+
+/*
+ * Portable float map: three little- or big-endian floats per pixel, rows bottom to top as the format requires.
+ * A negative scale in the header marks little-endian data.
+ */
+inline void write_pfm(std::ostream& out, const framebuffer& fb) {
+    const std::uint16_t probe = 1;
+    unsigned char first_byte;
+    std::memcpy(&first_byte, &probe, 1);
+    out << "PF\n" << fb.width() << ' ' << fb.height() << '\n' << (first_byte ? "-1.0" : "1.0") << '\n';
+
+    std::vector<float> buffer(static_cast<std::size_t>(fb.width()) * 3);
+    for_each_row(fb, [&](int, const color* row) {
+        for (int i = 0; i < fb.width(); i++) {
+            buffer[3 * i] = static_cast<float>(row[i].x());
+            buffer[3 * i + 1] = static_cast<float>(row[i].y());
+            buffer[3 * i + 2] = static_cast<float>(row[i].z());
+        }
+        out.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size() * 4));
+    }, row_order::bottom_up);
+}
+
+// Radiance RGBE: 8-bit mantissas over a shared exponent (G. Ward); negative channels clamp to zero.
+inline void color_to_rgbe(const color& c, unsigned char* rgbe) {
+    const double r = std::max(c.x(), 0.0), g = std::max(c.y(), 0.0), b = std::max(c.z(), 0.0);
+    const double v = std::max(r, std::max(g, b));
+    if (!(v >= 1e-32)) {
+        rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+        return;
+    }
+    int exponent;
+    const double scale = std::frexp(v, &exponent) * 256.0 / v;
+    rgbe[0] = static_cast<unsigned char>(r * scale);
+    rgbe[1] = static_cast<unsigned char>(g * scale);
+    rgbe[2] = static_cast<unsigned char>(b * scale);
+    rgbe[3] = static_cast<unsigned char>(exponent + 128);
+}
+
+inline void write_hdr_header(std::ostream& out, int width, int height) {
+    out << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << height << " +X " << width << '\n';
+}
+
+// Flat (uncompressed) scanline, which every Radiance reader accepts; `buffer` holds 4 * width bytes.
+inline void write_hdr_row(std::ostream& out, const color* row, int width, unsigned char* buffer) {
+    for (int i = 0; i < width; i++) color_to_rgbe(row[i], buffer + 4 * i);
+    out.write(reinterpret_cast<const char*>(buffer), static_cast<std::streamsize>(width) * 4);
+}
+
+// Radiance HDR of a whole framebuffer, top to bottom.
+inline void write_hdr(std::ostream& out, const framebuffer& fb) {
+    write_hdr_header(out, fb.width(), fb.height());
+    std::vector<unsigned char> buffer(static_cast<std::size_t>(fb.width()) * 4);
+    for_each_row(fb, [&](int, const color* row) { write_hdr_row(out, row, fb.width(), buffer.data()); });
+}
+
+/*
+ * 8-bit PNG of a whole framebuffer, with the same pixels as write_ppm, encoded on `threads` threads (0 for one per
+ * hardware thread). Rows of tiles are released once every strip that reads them is written.
+ */
+inline void write_png(std::ostream& out, const framebuffer& fb, unsigned threads = 0,
+                      dither_mode dither = dither_mode::none) {
+    int released_tile_rows = 0;
+    encode_png(out, fb.width(), fb.height(),
+        [&](int y, unsigned char* bytes) {
+            std::vector<color> row(fb.width());
+            fb.read_row(y, row.data());
+            quantize_row(row.data(), fb.width(), bytes, y, dither);
+        },
+        [&](int rows_written) {
+            // The next strip also reads the row above it, so keep the tile row holding that one.
+            const int keep_from = rows_written < fb.height() ? (rows_written - 1) / fb.tile_size() : fb.tiles_y();
+            for (; released_tile_rows < keep_from; released_tile_rows++) {
+                for (int tx = 0; tx < fb.tiles_x(); tx++) fb.release_tile(released_tile_rows * fb.tiles_x() + tx);
+            }
+        },
+        threads);
+}
+
+// Writes `fb` as "ppm", "png", "pfm" or "hdr"; false for any other format name. Dithering applies to 8-bit formats.
+inline bool write_image(std::ostream& out, const framebuffer& fb, const std::string& format, unsigned threads = 0,
+                        dither_mode dither = dither_mode::none) {
+    if (format == "ppm") {
+        write_ppm(out, fb, dither);
+    } else if (format == "png") {
+        write_png(out, fb, threads, dither);
+    } else if (format == "pfm") {
+        write_pfm(out, fb);
+    } else if (format == "hdr") {
+        write_hdr(out, fb);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#endif
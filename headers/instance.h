@@ -0,0 +1,183 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "bvh_build.h"
+#include "hittable.h"
+#include "transform.h"
+
+#include <cstdint>  // For instance indices.
+#include <vector>   // For the instance list and bounds.
+
+/*
+ * Placed copy of shared geometry.
+ * Holds only a reference to the bottom-level structure (BLAS) and its object-to-world transform, so memory grows with
+ * unique geometry rather than with copies. Rays are moved into object space without renormalizing the direction, so hit
+ * distances are the same in both spaces and the interval needs no rescaling.
+ */
+class instance : public hittable {
+private:
+    shared_ptr<hittable> object;
+    affine_transform to_world;
+    affine_transform to_object;
+    aabb bbox;
+
+public:
+    instance(shared_ptr<hittable> object, const affine_transform& to_world)
+        : object(std::move(object)), to_world(to_world), to_object(to_world.inverse()),
+          bbox(to_world.apply_box(this->object->bounding_box())) {}
+
+    void set_transform(const affine_transform& xf) {
+        to_world = xf;
+        to_object = xf.inverse();
+        bbox = to_world.apply_box(object->bounding_box());
+    }
+
+    const affine_transform& transform() const { return to_world; }
+    const shared_ptr<hittable>& geometry() const { return object; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        ray local(to_object.apply_point(r.origin()), to_object.apply_vector(r.direction()));
+        if (!object->hit(local, ray_t, rec)) return false;
+
+        // The inverse transpose maps normals and keeps their side of the surface, so front_face still holds.
+        rec.p = to_world.apply_point(rec.p);
+        rec.normal = unit_vector(to_object.apply_transposed(rec.normal));
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return object->occluded(ray(to_object.apply_point(r.origin()), to_object.apply_vector(r.direction())), ray_t);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+};
+
+/*
+ * Top-level acceleration structure over instances (TLAS).
+ * A flat bvh_node tree whose leaves hold instance indices, built with the same builders as the sphere BVHs. Instance
+ * counts are small next to primitive counts, so moving instances and calling rebuild() costs far less than rebuilding
+ * any bottom-level structure; set_transform() only updates the instance's cached bounds.
+ */
+class tlas : public hittable {
+private:
+    std::vector<instance> instances;
+    std::vector<std::uint32_t> leaf_instances;  // Instance indices in leaf order
+    aligned_vector<bvh_node> nodes;
+    bvh_builder builder;
+    unsigned threads;
+    aabb bbox;
+
+    static constexpr int stack_size = 128;
+
+public:
+    explicit tlas(std::vector<instance> instances, bvh_builder builder = bvh_builder::binned_sah, unsigned threads = 0)
+        : instances(std::move(instances)), builder(builder), threads(threads) {
+        rebuild();
+    }
+
+    std::size_t instance_count() const { return instances.size(); }
+    const instance& get_instance(std::size_t i) const { return instances[i]; }
+    std::size_t node_bytes() const { return nodes.size() * sizeof(bvh_node); }
+
+    // Moves one instance; the tree is stale until rebuild(), so batch moves and rebuild once per frame.
+    void set_transform(std::size_t i, const affine_transform& xf) { instances[i].set_transform(xf); }
+
+    void rebuild() {
+        std::vector<aabb> bounds(instances.size());
+        bbox = aabb::empty;
+        for (std::size_t i = 0; i < instances.size(); i++) {
+            bounds[i] = instances[i].bounding_box();
+            bbox = aabb(bbox, bounds[i]);
+        }
+
+        nodes.clear();
+        if (instances.empty()) return;
+        bvh_build_tree tree = build_bvh_tree(bounds, builder, threads);
+        leaf_instances = std::move(tree.prim_order);
+        nodes.reserve(tree.nodes.size());
+        flatten_bvh(tree, tree.root, nodes);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty()) return false;
+
+        const point3& origin = r.origin();
+        const vec3 dir = r.direction();
+        const double o[3] = {origin.x(), origin.y(), origin.z()};
+        const double inv_dir[3] = {1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z()};
+        const bool dir_negative[3] = {dir.x() < 0, dir.y() < 0, dir.z() < 0};
+
+        double closest_so_far = ray_t.max;
+        bool hit_anything = false;
+        std::uint32_t stack[stack_size];
+        int top = 0;
+        std::uint32_t current = 0;
+
+        while (true) {
+            const bvh_node& node = nodes[current];
+            if (node.hit(o, inv_dir, ray_t.min, closest_so_far)) {
+                if (node.is_leaf()) {
+                    for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        if (instances[leaf_instances[i]].hit(r, interval(ray_t.min, closest_so_far), rec)) {
+                            hit_anything = true;
+                            closest_so_far = rec.t;
+                        }
+                    }
+                } else if (dir_negative[node.axis]) {
+                    stack[top++] = current + 1;
+                    current = node.offset;
+                    continue;
+                } else {
+                    stack[top++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (top == 0) break;
+            current = stack[--top];
+        }
+        return hit_anything;
+    }
+
+    // Same walk as hit(), stopping at the first occluding instance; children are visited in node order.
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (nodes.empty()) return false;
+
+        const point3& origin = r.origin();
+        const vec3 dir = r.direction();
+        const double o[3] = {origin.x(), origin.y(), origin.z()};
+        const double inv_dir[3] = {1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z()};
+
+        std::uint32_t stack[stack_size];
+        int top = 0;
+        std::uint32_t current = 0;
+
+        while (true) {
+            const bvh_node& node = nodes[current];
+            if (node.hit(o, inv_dir, ray_t.min, ray_t.max)) {
+                if (node.is_leaf()) {
+                    for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        if (instances[leaf_instances[i]].occluded(r, ray_t)) return true;
+                    }
+                } else {
+                    stack[top++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (top == 0) break;
+            current = stack[--top];
+        }
+        return false;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+};
+
+#endif
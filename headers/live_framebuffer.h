@@ -0,0 +1,293 @@
+#ifndef LIVE_FRAMEBUFFER_H
+#define LIVE_FRAMEBUFFER_H
+
+#include "rtweekend.h"
+#include "accumulation_buffer.h"
+#include "framebuffer.h"
+
+#include <atomic>   // For the generation and tile sequence counters.
+#include <cstddef>  // For std::size_t.
+#include <cstdint>  // For the segment header.
+#include <cstring>  // For the magic.
+#include <new>      // For placement new of the counters.
+#include <string>   // For segment names.
+#include <vector>   // For tile snapshots.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Live accumulation buffer in POSIX shared memory, for external preview tools.
+ * The segment holds a small header, one sequence counter per tile, the per-tile totals (channel sums and sample
+ * count) and the float sums, in accumulation_buffer's tile layout. The renderer accumulates directly into the segment,
+ * so publishing costs no copy: each tile update is bracketed by a per-tile seqlock and followed by a bump of the
+ * header's generation counter, a few atomic operations per tile. Viewers map the segment read-only, poll the
+ * generation, and take consistent tile snapshots with live_framebuffer_view.
+ */
+
+namespace live_detail {
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free && std::atomic<std::uint64_t>::is_always_lock_free,
+              "counters in shared memory must be lock-free");
+
+constexpr char magic[8] = {'R', 'T', 'L', 'I', 'V', 'E', '0', '1'};
+
+// Segment header; the sections after it start at the recorded offsets, each 64-byte aligned.
+struct segment_header {
+    char magic[8];
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t tile_size;
+    std::uint32_t tile_count;
+    std::uint64_t sequence_offset;
+    std::uint64_t totals_offset;
+    std::uint64_t sums_offset;
+    std::uint64_t segment_bytes;
+    std::atomic<std::uint64_t> generation;  // Bumped after every tile update
+};
+
+// Section offsets and total size for a layout.
+struct segment_layout {
+    std::size_t sequence_offset, totals_offset, sums_offset, bytes;
+
+    explicit segment_layout(int tile_count, std::size_t tile_pixels) {
+        auto align = [](std::size_t n) { return (n + 63) / 64 * 64; };
+        const std::size_t tiles = static_cast<std::size_t>(tile_count);
+        sequence_offset = align(sizeof(segment_header));
+        totals_offset = align(sequence_offset + tiles * sizeof(std::atomic<std::uint32_t>));
+        sums_offset = align(totals_offset + tiles * sizeof(accumulation_tile_totals));
+        bytes = sums_offset + tiles * tile_pixels * sizeof(rgb32f_format::stored);
+    }
+};
+
+struct mapping {
+    unsigned char* base = nullptr;
+    std::size_t length = 0;
+};
+
+}  // namespace live_detail
+
+// Renderer side: an accumulation buffer whose storage is a named shared-memory segment (e.g. "/rt_live").
+class shared_accumulation_buffer : public accumulation_buffer {
+private:
+    std::string segment_name;
+    live_detail::mapping segment;
+    live_detail::segment_header* header = nullptr;
+    std::atomic<std::uint32_t>* sequences = nullptr;
+
+    // Creates the segment and maps it; an empty mapping on failure. A stale segment of the same name is unlinked
+    // rather than truncated, so a viewer still mapping it does not fault.
+    static live_detail::mapping create(const std::string& name, const live_detail::segment_layout& layout) {
+        live_detail::mapping m;
+        ::shm_unlink(name.c_str());
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) return m;
+        if (::ftruncate(fd, static_cast<off_t>(layout.bytes)) == 0) {
+            // Populated up front, as private storage is zero-filled up front, so the first pass takes no faults.
+            void* p = ::mmap(nullptr, layout.bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+            if (p != MAP_FAILED) {
+                m.base = static_cast<unsigned char*>(p);
+                m.length = layout.bytes;
+            }
+        }
+        ::close(fd);
+        if (!m.base) ::shm_unlink(name.c_str());
+        return m;
+    }
+
+    static int count_tiles(int width, int height, int tile_size) {
+        return ((width + tile_size - 1) / tile_size) * ((height + tile_size - 1) / tile_size);
+    }
+
+    template <typename T>
+    static T* section(const live_detail::mapping& m, std::size_t offset) {
+        return m.base ? reinterpret_cast<T*>(m.base + offset) : nullptr;
+    }
+
+    shared_accumulation_buffer(const std::string& name, int width, int height, int tile_size,
+                               const live_detail::segment_layout& layout)
+        : shared_accumulation_buffer(name, width, height, tile_size, layout, create(name, layout)) {}
+
+    shared_accumulation_buffer(const std::string& name, int width, int height, int tile_size,
+                               const live_detail::segment_layout& layout, live_detail::mapping m)
+        : accumulation_buffer(width, height, tile_size, section<stored>(m, layout.sums_offset),
+                              section<tile_totals>(m, layout.totals_offset)),
+          segment_name(name), segment(m) {
+        if (!segment.base) return;
+        // ftruncate zero-filled the segment, which is already the empty accumulation; only the counters and header
+        // need constructing. The magic goes in last, so a viewer never sees a half-written header as valid.
+        sequences = reinterpret_cast<std::atomic<std::uint32_t>*>(segment.base + layout.sequence_offset);
+        for (int t = 0; t < tile_count(); t++) new (&sequences[t]) std::atomic<std::uint32_t>(0);
+        header = new (segment.base) live_detail::segment_header;
+        header->width = static_cast<std::uint32_t>(width);
+        header->height = static_cast<std::uint32_t>(height);
+        header->tile_size = static_cast<std::uint32_t>(tile_size);
+        header->tile_count = static_cast<std::uint32_t>(tile_count());
+        header->sequence_offset = layout.sequence_offset;
+        header->totals_offset = layout.totals_offset;
+        header->sums_offset = layout.sums_offset;
+        header->segment_bytes = layout.bytes;
+        header->generation.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, live_detail::magic, sizeof(header->magic));
+    }
+
+protected:
+    // Seqlock writer side: the sequence is odd while the tile changes. Tiles have one writer at a time.
+    void begin_tile_update(int t) override {
+        if (!sequences) return;
+        sequences[t].store(sequences[t].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_tile_update(int t) override {
+        if (!sequences) return;
+        sequences[t].store(sequences[t].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        header->generation.fetch_add(1, std::memory_order_release);
+    }
+
+public:
+    shared_accumulation_buffer(const std::string& name, int width, int height, int tile_size = 32)
+        : shared_accumulation_buffer(name, width, height, tile_size,
+                                     live_detail::segment_layout(count_tiles(width, height, tile_size),
+                                                                 static_cast<std::size_t>(tile_size) * tile_size)) {}
+
+    // The name is removed when the renderer is done; viewers that still have the segment mapped keep their view.
+    ~shared_accumulation_buffer() override {
+        if (!segment.base) return;
+        ::munmap(segment.base, segment.length);
+        ::shm_unlink(segment_name.c_str());
+    }
+
+    // False if the segment could not be created; the buffer then accumulates in private memory.
+    bool valid() const { return segment.base != nullptr; }
+    const std::string& name() const { return segment_name; }
+    std::size_t segment_bytes() const { return segment.length; }
+};
+
+/*
+ * Viewer side: a read-only mapping of a live segment.
+ * A tile is read by copying its totals and sums between two loads of its sequence counter and retrying if the
+ * renderer touched it meanwhile, so snapshots are never torn; the renderer never waits for viewers.
+ */
+class live_framebuffer_view : public tile_layout {
+private:
+    live_detail::mapping segment;
+    const live_detail::segment_header* header = nullptr;
+
+    // Maps `name` read-only and checks the header against the mapped size; an empty mapping if it is not a segment.
+    static live_detail::mapping open(const std::string& name) {
+        live_detail::mapping m;
+        int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return m;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(live_detail::segment_header)) {
+            const std::size_t length = static_cast<std::size_t>(st.st_size);
+            void* p = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                m.base = static_cast<unsigned char*>(p);
+                m.length = length;
+            }
+        }
+        ::close(fd);
+        if (!m.base) return m;
+
+        const auto* h = reinterpret_cast<const live_detail::segment_header*>(m.base);
+        const bool ok = std::memcmp(h->magic, live_detail::magic, sizeof(h->magic)) == 0 && h->tile_size > 0 &&
+                        h->tile_count == ((h->width + h->tile_size - 1) / h->tile_size) *
+                                             ((h->height + h->tile_size - 1) / h->tile_size) &&
+                        h->segment_bytes == m.length &&
+                        h->segment_bytes == live_detail::segment_layout(static_cast<int>(h->tile_count),
+                                                                        std::size_t(h->tile_size) * h->tile_size)
+                                                .bytes;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!ok) {
+            ::munmap(m.base, m.length);
+            m = live_detail::mapping();
+        }
+        return m;
+    }
+
+    static const live_detail::segment_header* header_of(const live_detail::mapping& m) {
+        return m.base ? reinterpret_cast<const live_detail::segment_header*>(m.base) : nullptr;
+    }
+
+    explicit live_framebuffer_view(live_detail::mapping m)
+        : tile_layout(m.base ? static_cast<int>(header_of(m)->width) : 0,
+                      m.base ? static_cast<int>(header_of(m)->height) : 0,
+                      m.base ? static_cast<int>(header_of(m)->tile_size) : 1),
+          segment(m), header(header_of(m)) {}
+
+    const std::atomic<std::uint32_t>& sequence(int t) const {
+        return reinterpret_cast<const std::atomic<std::uint32_t>*>(segment.base + header->sequence_offset)[t];
+    }
+
+    const accumulation_tile_totals& totals(int t) const {
+        return reinterpret_cast<const accumulation_tile_totals*>(segment.base + header->totals_offset)[t];
+    }
+
+    const rgb32f_format::stored* sums(int t) const {
+        return reinterpret_cast<const rgb32f_format::stored*>(segment.base + header->sums_offset) +
+               static_cast<std::size_t>(t) * tile_pixels();
+    }
+
+public:
+    explicit live_framebuffer_view(const std::string& name) : live_framebuffer_view(open(name)) {}
+
+    ~live_framebuffer_view() {
+        if (segment.base) ::munmap(segment.base, segment.length);
+    }
+
+    live_framebuffer_view(const live_framebuffer_view&) = delete;
+    live_framebuffer_view& operator=(const live_framebuffer_view&) = delete;
+
+    bool valid() const { return segment.base != nullptr; }
+
+    // Count of tile updates so far; a viewer redraws when it changes.
+    std::uint64_t generation() const { return header->generation.load(std::memory_order_acquire); }
+
+    // Samples accumulated in tile t, as of the last completed update.
+    std::uint64_t samples(int t) const {
+        accumulation_tile_totals snapshot;
+        std::uint32_t before, after;
+        do {
+            before = sequence(t).load(std::memory_order_acquire);
+            snapshot = totals(t);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence(t).load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        return snapshot.samples;
+    }
+
+    // Per-pixel means of tile t into `out`, tile_size apart per row, from a consistent snapshot; returns its samples.
+    std::uint64_t resolve_tile(int t, color* out) const {
+        thread_local std::vector<rgb32f_format::stored> snapshot;
+        snapshot.resize(tile_pixels());
+        accumulation_tile_totals snapshot_totals;
+        std::uint32_t before, after;
+        do {
+            before = sequence(t).load(std::memory_order_acquire);
+            snapshot_totals = totals(t);
+            std::memcpy(snapshot.data(), sums(t), tile_pixels() * sizeof(rgb32f_format::stored));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence(t).load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        resolve_accumulated_tile(snapshot.data(), snapshot_totals, tile_width(t), tile_height(t), tile_edge, out);
+        return snapshot_totals.samples;
+    }
+
+    // Resolves every tile into a framebuffer of the same layout, e.g. to write a preview image.
+    bool resolve(framebuffer& fb) const {
+        if (fb.width() != width() || fb.height() != height() || fb.tile_size() != tile_size()) return false;
+        std::vector<color> tile(tile_pixels());
+        for (int t = 0; t < tile_count(); t++) {
+            resolve_tile(t, tile.data());
+            fb.store_tile(t, tile.data());
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>  // For std::size_t.
+#include <cstdint>  // For file offsets.
+#include <cstdio>   // For std::rename.
+#include <fstream>  // For writing section files.
+#include <string>   // For file paths.
+#include <utility>  // For std::exchange in moves.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Read-only memory mapping of a whole file.
+ * Pages are faulted in on first touch, so opening costs the same whatever the file size and only the parts a run
+ * actually reads come off disk; the page cache shares them between runs and processes. An empty or missing file leaves
+ * the mapping closed.
+ */
+class mapped_file {
+private:
+    void* base = nullptr;
+    std::size_t length = 0;
+
+public:
+    mapped_file() = default;
+
+    explicit mapped_file(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                base = p;
+                length = static_cast<std::size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+    }
+
+    ~mapped_file() {
+        if (base) ::munmap(base, length);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept
+        : base(std::exchange(other.base, nullptr)), length(std::exchange(other.length, 0)) {}
+
+    mapped_file& operator=(mapped_file&& other) noexcept {
+        if (this != &other) {
+            if (base) ::munmap(base, length);
+            base = std::exchange(other.base, nullptr);
+            length = std::exchange(other.length, 0);
+        }
+        return *this;
+    }
+
+    bool is_open() const { return base != nullptr; }
+    const unsigned char* data() const { return static_cast<const unsigned char*>(base); }
+    std::size_t size() const { return length; }
+};
+
+/*
+ * Section files: a fixed header followed by raw arrays, each starting on a 64-byte boundary so a mapping can be read in
+ * place with aligned loads. Shared by the on-disk formats that are mapped rather than parsed.
+ */
+constexpr std::size_t mapped_section_alignment = 64;
+
+inline std::uint64_t align_section_offset(std::uint64_t offset) {
+    return (offset + mapped_section_alignment - 1) & ~std::uint64_t(mapped_section_alignment - 1);
+}
+
+// Places `count` sections after the header; fills their offsets and returns the file size.
+inline std::uint64_t layout_sections(std::size_t header_size, const std::uint64_t* lengths, int count,
+                                     std::uint64_t* offsets) {
+    std::uint64_t offset = align_section_offset(header_size);
+    for (int s = 0; s < count; s++) {
+        offsets[s] = offset;
+        offset = align_section_offset(offset + lengths[s]);
+    }
+    return offset;
+}
+
+// True if every section is aligned and lies inside a mapping of file_size bytes.
+inline bool sections_in_bounds(const std::uint64_t* offsets, const std::uint64_t* lengths, int count,
+                               std::uint64_t file_size) {
+    for (int s = 0; s < count; s++) {
+        if (offsets[s] % mapped_section_alignment != 0) return false;
+        if (offsets[s] > file_size || lengths[s] > file_size - offsets[s]) return false;
+    }
+    return true;
+}
+
+/*
+ * Writes the header and the sections at the offsets from layout_sections(), zero-padded. Goes through a temporary file
+ * that is synced before the rename, so concurrent readers only ever see complete files and a crash cannot leave an
+ * empty file under the final name. Returns false if the file cannot be written.
+ */
+inline bool write_section_file(const std::string& path, const void* header, std::size_t header_size,
+                               const void* const* sections, const std::uint64_t* lengths, const std::uint64_t* offsets,
+                               int count, std::uint64_t file_size) {
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        const char zeros[mapped_section_alignment] = {};
+        out.write(static_cast<const char*>(header), static_cast<std::streamsize>(header_size));
+        std::uint64_t written = header_size;
+        for (int s = 0; s < count; s++) {
+            out.write(zeros, static_cast<std::streamsize>(offsets[s] - written));
+            out.write(static_cast<const char*>(sections[s]), static_cast<std::streamsize>(lengths[s]));
+            written = offsets[s] + lengths[s];
+        }
+        out.write(zeros, static_cast<std::streamsize>(file_size - written));
+        out.flush();
+        if (!out) return false;
+    }
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    const bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced && std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+#endif
@@ -49,7 +49,11 @@ class metal : public material {
 			reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
 			scattered = ray(rec.p, reflected);
 			attenuation = albedo;
-			return (dot(scattered.direction(), rec.normal) > 0);
+			if (dot(scattered.direction(), rec.normal) > 0) {
+				return true;
+			}
+			RT_STAT(metal_rejections);
+			return false;
 		}
 };
 
@@ -80,6 +84,9 @@ class dielectric : public material {
 			bool cannot_refract = ri * sin_theta > 1.0;
 			vec3 direction;
 
+			if (cannot_refract) {
+				RT_STAT(total_internal_reflections);
+			}
 			if (cannot_refract || reflectance(cos_theta, ri) > random_double()) {
 				direction = reflect(unit_direction, rec.normal);
 			}
@@ -0,0 +1,61 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>  // For std::size_t.
+#include <thread>   // For std::thread and hardware_concurrency.
+#include <vector>   // For the worker list.
+
+/*
+ * Minimal fork-join helpers.
+ * Plain std::thread per call; callers parallelize coarse phases (builds, batches) where thread start-up is negligible.
+ */
+
+// Resolves a requested thread count; 0 means one per hardware thread.
+inline unsigned worker_count(unsigned requested = 0) {
+    if (requested > 0) return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+/*
+ * Splits [0, count) into `chunks` contiguous ranges and runs body(chunk, begin, end) for each, one thread per chunk.
+ * Chunk boundaries are deterministic, which per-chunk algorithms (histograms, prefix sums) rely on.
+ */
+template <typename F>
+void parallel_chunks(std::size_t count, unsigned chunks, F&& body) {
+    if (chunks <= 1 || count < 2) {
+        body(0u, std::size_t(0), count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    for (unsigned c = 1; c < chunks; c++) {
+        workers.emplace_back([&body, c, count, chunks] {
+            body(c, count * c / chunks, count * (c + 1) / chunks);
+        });
+    }
+    body(0u, std::size_t(0), count / chunks);
+    for (auto& w : workers) w.join();
+}
+
+// Runs body(begin, end) over [0, count), falling back to the calling thread below `grain` items per worker.
+template <typename F>
+void parallel_for(std::size_t count, F&& body, unsigned threads = 0, std::size_t grain = 1024) {
+    std::size_t max_chunks = count / (grain > 0 ? grain : 1);
+    unsigned chunks = worker_count(threads);
+    if (max_chunks < chunks) chunks = max_chunks > 0 ? static_cast<unsigned>(max_chunks) : 1;
+    parallel_chunks(count, chunks, [&body](unsigned, std::size_t begin, std::size_t end) { body(begin, end); });
+}
+
+// Runs body(worker) once on each of `workers` threads, the caller being worker 0; for loops that pull work dynamically.
+template <typename F>
+void parallel_workers(unsigned workers, F&& body) {
+    std::vector<std::thread> threads;
+    threads.reserve(workers > 1 ? workers - 1 : 0);
+    for (unsigned w = 1; w < workers; w++) threads.emplace_back([&body, w] { body(w); });
+    body(0u);
+    for (auto& t : threads) t.join();
+}
+
+#endif
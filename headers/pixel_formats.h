@@ -0,0 +1,153 @@
+#ifndef PIXEL_FORMATS_H
+#define PIXEL_FORMATS_H
+
+#include "rtweekend.h"
+
+#include <algorithm>  // For clamping and the shared-exponent maximum.
+#include <cmath>      // For rounding in RGB9E5.
+#include <cstdint>    // For the packed representations.
+#include <cstring>    // For float and double bit patterns.
+
+/*
+ * Pixel storage formats for framebuffers.
+ * Each format names its stored type and converts to and from color; framebuffers are templated on the format, and
+ * rendering and output code only ever see color. Smaller formats trade precision for memory and bandwidth.
+ */
+
+inline std::uint32_t float_bits(float f) {
+    std::uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline float bits_float(std::uint32_t u) {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/*
+ * IEEE binary16 conversion with round-to-nearest-even; overflow goes to infinity and NaN stays NaN.
+ * Subnormals are rounded by adding a magic number so the FPU does the rounding (after F. Giesen's float_to_half).
+ */
+inline std::uint16_t float_to_half(float f) {
+    const std::uint32_t float_infinity = 255u << 23;
+    const std::uint32_t half_overflow = (127u + 16) << 23;  // 2^16, first value that rounds to half infinity
+    const std::uint32_t subnormal_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+    std::uint32_t u = float_bits(f);
+    const std::uint32_t sign = u & 0x80000000u;
+    u ^= sign;
+
+    std::uint16_t h;
+    if (u >= half_overflow) {
+        h = u > float_infinity ? 0x7e00 : 0x7c00;
+    } else if (u < (113u << 23)) {
+        h = static_cast<std::uint16_t>(float_bits(bits_float(u) + bits_float(subnormal_magic)) - subnormal_magic);
+    } else {
+        const std::uint32_t mantissa_odd = (u >> 13) & 1;
+        u += (static_cast<std::uint32_t>(15 - 127) << 23) + 0xfff + mantissa_odd;
+        h = static_cast<std::uint16_t>(u >> 13);
+    }
+    return static_cast<std::uint16_t>(h | (sign >> 16));
+}
+
+inline float half_to_float(std::uint16_t h) {
+    const std::uint32_t shifted_exponent = 0x7c00u << 13;
+    std::uint32_t u = (h & 0x7fffu) << 13;
+    const std::uint32_t exponent = u & shifted_exponent;
+    u += static_cast<std::uint32_t>(127 - 15) << 23;
+
+    if (exponent == shifted_exponent) {
+        u += static_cast<std::uint32_t>(128 - 16) << 23;  // Infinity or NaN
+    } else if (exponent == 0) {
+        u += 1u << 23;  // Subnormal: renormalize through the FPU
+        u = float_bits(bits_float(u) - bits_float(113u << 23));
+    }
+    return bits_float(u | (static_cast<std::uint32_t>(h & 0x8000u) << 16));
+}
+
+// Plain double color, 24 bytes per pixel: the reference every other format is measured against.
+struct rgb64_format {
+    using stored = color;
+    static constexpr const char* name = "rgb64";
+
+    static stored encode(const color& c) { return c; }
+    static color decode(const stored& s) { return s; }
+};
+
+// Single-precision RGB, 12 bytes per pixel.
+struct rgb32f_format {
+    struct stored {
+        float r, g, b;
+    };
+    static constexpr const char* name = "rgb32f";
+
+    static stored encode(const color& c) {
+        return {static_cast<float>(c.x()), static_cast<float>(c.y()), static_cast<float>(c.z())};
+    }
+    static color decode(const stored& s) { return color(s.r, s.g, s.b); }
+};
+
+// Half-precision RGB, 6 bytes per pixel; about three significant digits over 6e-5 .. 65504.
+struct rgb16f_format {
+    struct stored {
+        std::uint16_t r, g, b;
+    };
+    static constexpr const char* name = "rgb16f";
+
+    static stored encode(const color& c) {
+        return {float_to_half(static_cast<float>(c.x())), float_to_half(static_cast<float>(c.y())),
+                float_to_half(static_cast<float>(c.z()))};
+    }
+    static color decode(const stored& s) { return color(half_to_float(s.r), half_to_float(s.g), half_to_float(s.b)); }
+};
+
+/*
+ * Shared-exponent RGB9E5, 4 bytes per pixel (EXT_texture_shared_exponent): three 9-bit mantissas over one 5-bit
+ * exponent. Non-negative values only, up to 65408; meant for final output, where channels are close in magnitude.
+ */
+struct rgb9e5_format {
+    using stored = std::uint32_t;
+    static constexpr const char* name = "rgb9e5";
+
+    static constexpr int mantissa_bits = 9;
+    static constexpr int exponent_bias = 15;
+    static constexpr double max_value = 65408.0;  // (2^9 - 1) / 2^9 * 2^(31 - 15)
+
+    static double clamp_channel(double v) { return v > 0 ? std::min(v, max_value) : 0.0; }  // NaN goes to 0
+
+    // 2^k for the exponents RGB9E5 needs, built directly rather than through ldexp.
+    static double power_of_two(int k) {
+        const std::uint64_t bits = static_cast<std::uint64_t>(1023 + k) << 52;
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+
+    static stored encode(const color& c) {
+        const double r = clamp_channel(c.x()), g = clamp_channel(c.y()), b = clamp_channel(c.z());
+        const double max_channel = std::max(r, std::max(g, b));
+
+        // floor(log2(max_channel)) from the exponent field; anything below 2^-16 shares the smallest exponent.
+        std::uint64_t bits;
+        std::memcpy(&bits, &max_channel, sizeof(bits));
+        const int max_log2 = static_cast<int>(bits >> 52) - 1023;
+        int shared = std::max(-exponent_bias - 1, max_log2) + 1 + exponent_bias;
+        double scale = power_of_two(mantissa_bits + exponent_bias - shared);
+        if (std::floor(max_channel * scale + 0.5) == (1 << mantissa_bits)) {
+            shared++;
+            scale *= 0.5;
+        }
+
+        auto mantissa = [scale](double v) { return static_cast<std::uint32_t>(std::floor(v * scale + 0.5)); };
+        return mantissa(r) | mantissa(g) << 9 | mantissa(b) << 18 | static_cast<std::uint32_t>(shared) << 27;
+    }
+
+    static color decode(stored s) {
+        const double scale = power_of_two(static_cast<int>(s >> 27) - exponent_bias - mantissa_bits);
+        return color((s & 0x1ff) * scale, ((s >> 9) & 0x1ff) * scale, ((s >> 18) & 0x1ff) * scale);
+    }
+};
+
+#endif
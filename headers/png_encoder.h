@@ -0,0 +1,568 @@
+#ifndef PNG_ENCODER_H
+#define PNG_ENCODER_H
+
+#include "parallel.h"
+
+#include <algorithm>   // For std::min, std::max and std::upper_bound.
+#include <atomic>      // For the shared strip counter.
+#include <cstddef>     // For std::size_t.
+#include <cstdint>     // For checksums and bit buffers.
+#include <cstdlib>     // For std::abs.
+#include <functional>  // For the min-heap ordering.
+#include <ostream>     // For the output stream.
+#include <queue>       // For building Huffman trees.
+#include <utility>     // For std::pair and std::swap.
+#include <vector>      // For byte buffers.
+
+/*
+ * Dependency-free PNG encoder for 8-bit RGB images.
+ * The image is cut into strips of rows, and each strip is filtered and deflated on its own thread as an independent
+ * run of deflate blocks (LZ77 with hash chains, then dynamic or fixed Huffman codes, whichever is smaller, or stored).
+ * Every strip but the last ends in an empty stored block (a zlib sync flush), so strips are byte-aligned and their
+ * outputs simply concatenate into one valid zlib stream. Each strip goes out as its own IDAT chunk, so chunk CRCs are
+ * computed by the strip's thread too; only the Adler-32 of the whole stream is combined from per-strip values at the
+ * end. Strips are encoded a batch at a time, so memory stays bounded by a few strips of compressed data.
+ */
+namespace png_detail {
+
+inline const std::uint32_t* crc_table() {
+    static const auto table = [] {
+        std::vector<std::uint32_t> t(256);
+        for (std::uint32_t n = 0; n < 256; n++) {
+            std::uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+inline std::uint32_t crc32(std::uint32_t crc, const unsigned char* data, std::size_t n) {
+    const std::uint32_t* table = crc_table();
+    crc = ~crc;
+    for (std::size_t i = 0; i < n; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+constexpr std::uint32_t adler_base = 65521;
+
+inline std::uint32_t adler32(std::uint32_t adler, const unsigned char* data, std::size_t n) {
+    std::uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (n > 0) {
+        const std::size_t run = std::min<std::size_t>(n, 5552);  // Largest run whose sums cannot overflow 32 bits
+        for (std::size_t i = 0; i < run; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= adler_base;
+        b %= adler_base;
+        data += run;
+        n -= run;
+    }
+    return a | b << 16;
+}
+
+// Adler-32 of the concatenation of two buffers, from their checksums and the second one's length (as zlib does).
+inline std::uint32_t adler32_combine(std::uint32_t first, std::uint32_t second, std::size_t second_length) {
+    const std::uint32_t rem = static_cast<std::uint32_t>(second_length % adler_base);
+    std::uint32_t a = first & 0xffff;
+    std::uint32_t b = static_cast<std::uint32_t>((static_cast<std::uint64_t>(rem) * a) % adler_base);
+    a += (second & 0xffff) + adler_base - 1;
+    b += (first >> 16) + (second >> 16) + adler_base - rem;
+    if (a >= adler_base) a -= adler_base;
+    if (a >= adler_base) a -= adler_base;
+    if (b >= 2 * adler_base) b -= 2 * adler_base;
+    if (b >= adler_base) b -= adler_base;
+    return a | b << 16;
+}
+
+// Deflate bit order: values go in least significant bit first, Huffman codes are pre-reversed by the caller.
+class bit_writer {
+private:
+    std::vector<unsigned char>& out;
+    std::uint64_t bits = 0;
+    int count = 0;
+
+public:
+    explicit bit_writer(std::vector<unsigned char>& out) : out(out) {}
+
+    void put(std::uint32_t value, int n) {
+        bits |= static_cast<std::uint64_t>(value) << count;
+        count += n;
+        while (count >= 8) {
+            out.push_back(static_cast<unsigned char>(bits));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void align() {
+        if (count > 0) put(0, 8 - count);
+    }
+};
+
+constexpr int length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr int distance_base[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                   193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr int distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12,
+                                    12, 13, 13};
+constexpr int code_length_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+inline int length_code(int length) {
+    return static_cast<int>(std::upper_bound(length_base, length_base + 29, length) - length_base) - 1;
+}
+
+inline int distance_code(int distance) {
+    return static_cast<int>(std::upper_bound(distance_base, distance_base + 30, distance) - distance_base) - 1;
+}
+
+// LZ77 output: a literal byte (distance 0) or a back-reference of `length` bytes `distance` back.
+struct token {
+    std::uint16_t length_or_literal;
+    std::uint16_t distance;
+};
+
+/*
+ * Greedy LZ77 over one strip with hash chains of 3-byte prefixes; the 32 KiB window never reaches into another
+ * strip, which is what lets strips be compressed independently.
+ */
+class matcher {
+private:
+    static constexpr int hash_bits = 15;
+    static constexpr int window = 32768;
+    static constexpr int max_chain = 48;
+    static constexpr int min_match = 3;
+    static constexpr int max_match = 258;
+
+    const unsigned char* data;
+    std::size_t size;
+    std::vector<std::int32_t> head;
+    std::vector<std::int32_t> previous;
+
+    std::uint32_t hash(std::size_t i) const {
+        const std::uint32_t v = data[i] | data[i + 1] << 8 | data[i + 2] << 16;
+        return (v * 2654435761u) >> (32 - hash_bits);
+    }
+
+    void insert(std::size_t i) {
+        if (i + min_match > size) return;
+        const std::uint32_t h = hash(i);
+        previous[i % window] = head[h];
+        head[h] = static_cast<std::int32_t>(i);
+    }
+
+public:
+    matcher(const unsigned char* data, std::size_t size)
+        : data(data), size(size), head(std::size_t(1) << hash_bits, -1), previous(window, -1) {}
+
+    // Tokens for bytes [begin, end); matches may reach back before `begin` but not past `end`.
+    void tokens(std::size_t begin, std::size_t end, std::vector<token>& out) {
+        std::size_t i = begin;
+        while (i < end) {
+            int best_length = 0, best_distance = 0;
+            if (i + min_match <= end) {
+                const std::size_t limit = std::min<std::size_t>(max_match, end - i);
+                std::int32_t candidate = head[hash(i)];
+                for (int chain = 0; candidate >= 0 && chain < max_chain; chain++) {
+                    const std::size_t c = static_cast<std::size_t>(candidate);
+                    if (i - c > window - 1) break;
+                    if (data[c + best_length] == data[i + best_length]) {
+                        std::size_t n = 0;
+                        while (n < limit && data[c + n] == data[i + n]) n++;
+                        if (static_cast<int>(n) > best_length) {
+                            best_length = static_cast<int>(n);
+                            best_distance = static_cast<int>(i - c);
+                            if (n == limit) break;
+                        }
+                    }
+                    const std::int32_t next = previous[c % window];
+                    if (next >= candidate) break;  // Slot reused by a newer position
+                    candidate = next;
+                }
+            }
+
+            if (best_length >= min_match) {
+                out.push_back({static_cast<std::uint16_t>(best_length), static_cast<std::uint16_t>(best_distance)});
+                for (int k = 0; k < best_length; k++) insert(i + k);
+                i += best_length;
+            } else {
+                out.push_back({data[i], 0});
+                insert(i);
+                i++;
+            }
+        }
+    }
+};
+
+/*
+ * Huffman code lengths for `freq`, at most `limit` bits. Over-long trees are rebuilt from flattened frequencies,
+ * which costs a little optimality in rare cases and keeps the code short. A single used symbol gets one bit.
+ */
+inline std::vector<std::uint8_t> huffman_lengths(std::vector<std::uint32_t> freq, int limit) {
+    const int n = static_cast<int>(freq.size());
+    std::vector<std::uint8_t> lengths(n, 0);
+    for (;;) {
+        using node = std::pair<std::uint64_t, int>;
+        std::priority_queue<node, std::vector<node>, std::greater<node>> heap;
+        std::vector<int> parent(2 * n, -1);
+        for (int s = 0; s < n; s++) {
+            if (freq[s]) heap.push({freq[s], s});
+        }
+        if (heap.empty()) return lengths;
+        if (heap.size() == 1) {
+            lengths[heap.top().second] = 1;
+            return lengths;
+        }
+
+        int next = n;
+        while (heap.size() > 1) {
+            node a = heap.top();
+            heap.pop();
+            node b = heap.top();
+            heap.pop();
+            parent[a.second] = parent[b.second] = next;
+            heap.push({a.first + b.first, next++});
+        }
+
+        int longest = 0;
+        for (int s = 0; s < n; s++) {
+            if (!freq[s]) continue;
+            int depth = 0;
+            for (int p = parent[s]; p >= 0; p = parent[p]) depth++;
+            lengths[s] = static_cast<std::uint8_t>(depth);
+            longest = std::max(longest, depth);
+        }
+        if (longest <= limit) return lengths;
+        for (auto& f : freq) {
+            if (f) f = (f >> 1) | 1;
+        }
+    }
+}
+
+// Canonical codes for `lengths`, bit-reversed for the LSB-first bit writer.
+inline std::vector<std::uint16_t> huffman_codes(const std::vector<std::uint8_t>& lengths) {
+    int count[16] = {0};
+    for (auto l : lengths) count[l]++;
+    count[0] = 0;
+    int next[16] = {0};
+    for (int bits = 1, code = 0; bits < 16; bits++) {
+        code = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+
+    std::vector<std::uint16_t> codes(lengths.size(), 0);
+    for (std::size_t s = 0; s < lengths.size(); s++) {
+        const int l = lengths[s];
+        if (!l) continue;
+        int code = next[l]++, reversed = 0;
+        for (int b = 0; b < l; b++) reversed |= ((code >> b) & 1) << (l - 1 - b);
+        codes[s] = static_cast<std::uint16_t>(reversed);
+    }
+    return codes;
+}
+
+// Code-length alphabet run: symbol 0-15 is a literal length, 16 repeats the previous, 17 and 18 are zero runs.
+struct length_run {
+    std::uint8_t symbol;
+    std::uint8_t extra;
+};
+
+inline std::vector<length_run> run_length_encode(const std::vector<std::uint8_t>& lengths) {
+    std::vector<length_run> runs;
+    std::size_t i = 0;
+    while (i < lengths.size()) {
+        const std::uint8_t l = lengths[i];
+        std::size_t run = 1;
+        while (i + run < lengths.size() && lengths[i + run] == l) run++;
+        std::size_t left = run;
+        if (l == 0) {
+            while (left >= 11) {
+                const std::size_t k = std::min<std::size_t>(left, 138);
+                runs.push_back({18, static_cast<std::uint8_t>(k - 11)});
+                left -= k;
+            }
+            if (left >= 3) {
+                runs.push_back({17, static_cast<std::uint8_t>(left - 3)});
+                left = 0;
+            }
+        } else {
+            runs.push_back({l, 0});
+            left--;
+            while (left >= 3) {
+                const std::size_t k = std::min<std::size_t>(left, 6);
+                runs.push_back({16, static_cast<std::uint8_t>(k - 3)});
+                left -= k;
+            }
+        }
+        for (; left > 0; left--) runs.push_back({l, 0});
+        i += run;
+    }
+    return runs;
+}
+
+inline int run_extra_bits(int symbol) { return symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0; }
+
+/*
+ * Deflates one non-empty strip into `out`: blocks of up to 64 KiB of input, each dynamic, fixed or stored, whichever is
+ * smallest. The last strip sets BFINAL; the others end in an empty stored block so the next strip starts on a byte.
+ */
+inline void deflate_strip(const unsigned char* data, std::size_t size, bool last, std::vector<unsigned char>& out) {
+    static constexpr std::size_t block_bytes = 65535;  // Also the most a stored block can hold
+    bit_writer writer(out);
+    matcher lz(data, size);
+    std::vector<token> tokens;
+
+    std::vector<std::uint8_t> fixed_lengths(288, 8);
+    std::fill(fixed_lengths.begin() + 144, fixed_lengths.begin() + 256, 9);
+    std::fill(fixed_lengths.begin() + 256, fixed_lengths.begin() + 280, 7);
+    const std::vector<std::uint8_t> fixed_distance_lengths(30, 5);
+    const std::vector<std::uint16_t> fixed_codes = huffman_codes(fixed_lengths);
+    const std::vector<std::uint16_t> fixed_distance_codes = huffman_codes(fixed_distance_lengths);
+
+    for (std::size_t begin = 0; begin < size; begin += block_bytes) {
+        const std::size_t end = std::min(size, begin + block_bytes);
+        const bool final_block = last && end == size;
+        tokens.clear();
+        lz.tokens(begin, end, tokens);
+
+        std::vector<std::uint32_t> literal_freq(286, 0), distance_freq(30, 0);
+        std::uint64_t extra_bits = 0;
+        for (const token& t : tokens) {
+            if (t.distance == 0) {
+                literal_freq[t.length_or_literal]++;
+            } else {
+                const int lc = length_code(t.length_or_literal), dc = distance_code(t.distance);
+                literal_freq[257 + lc]++;
+                distance_freq[dc]++;
+                extra_bits += length_extra[lc] + distance_extra[dc];
+            }
+        }
+        literal_freq[256] = 1;
+
+        std::vector<std::uint8_t> literal_lengths = huffman_lengths(literal_freq, 15);
+        std::vector<std::uint8_t> distance_lengths = huffman_lengths(distance_freq, 15);
+        if (std::all_of(distance_lengths.begin(), distance_lengths.end(), [](std::uint8_t l) { return l == 0; })) {
+            distance_lengths[0] = 1;
+        }
+
+        int literal_count = 286, distance_count = 30;
+        while (literal_count > 257 && literal_lengths[literal_count - 1] == 0) literal_count--;
+        while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) distance_count--;
+        std::vector<std::uint8_t> all_lengths(literal_lengths.begin(), literal_lengths.begin() + literal_count);
+        all_lengths.insert(all_lengths.end(), distance_lengths.begin(), distance_lengths.begin() + distance_count);
+        const std::vector<length_run> runs = run_length_encode(all_lengths);
+
+        std::vector<std::uint32_t> run_freq(19, 0);
+        for (const length_run& r : runs) run_freq[r.symbol]++;
+        const std::vector<std::uint8_t> run_lengths = huffman_lengths(run_freq, 7);
+        int run_code_count = 19;
+        while (run_code_count > 4 && run_lengths[code_length_order[run_code_count - 1]] == 0) run_code_count--;
+
+        std::uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * static_cast<std::uint64_t>(run_code_count) + extra_bits;
+        std::uint64_t fixed_bits = 3 + extra_bits;
+        for (const length_run& r : runs) dynamic_bits += run_lengths[r.symbol] + run_extra_bits(r.symbol);
+        for (int s = 0; s < 286; s++) {
+            dynamic_bits += static_cast<std::uint64_t>(literal_freq[s]) * literal_lengths[s];
+            fixed_bits += static_cast<std::uint64_t>(literal_freq[s]) * fixed_lengths[s];
+        }
+        for (int s = 0; s < 30; s++) {
+            dynamic_bits += static_cast<std::uint64_t>(distance_freq[s]) * distance_lengths[s];
+            fixed_bits += static_cast<std::uint64_t>(distance_freq[s]) * 5;
+        }
+        const std::uint64_t stored_bits = (end - begin + 5) * 8 + 7;
+
+        if (stored_bits <= std::min(dynamic_bits, fixed_bits)) {
+            writer.put(final_block ? 1 : 0, 1);
+            writer.put(0, 2);
+            writer.align();
+            const std::uint32_t n = static_cast<std::uint32_t>(end - begin);
+            writer.put(n, 16);
+            writer.put(~n & 0xffff, 16);
+            out.insert(out.end(), data + begin, data + end);
+        } else {
+            const bool dynamic = dynamic_bits < fixed_bits;
+            const std::vector<std::uint16_t> literal_codes = dynamic ? huffman_codes(literal_lengths) : fixed_codes;
+            const std::vector<std::uint16_t> distance_codes =
+                dynamic ? huffman_codes(distance_lengths) : fixed_distance_codes;
+            const std::vector<std::uint8_t>& lit_len = dynamic ? literal_lengths : fixed_lengths;
+            const std::vector<std::uint8_t>& dist_len = dynamic ? distance_lengths : fixed_distance_lengths;
+
+            writer.put(final_block ? 1 : 0, 1);
+            writer.put(dynamic ? 2 : 1, 2);
+            if (dynamic) {
+                const std::vector<std::uint16_t> run_codes = huffman_codes(run_lengths);
+                writer.put(literal_count - 257, 5);
+                writer.put(distance_count - 1, 5);
+                writer.put(run_code_count - 4, 4);
+                for (int k = 0; k < run_code_count; k++) writer.put(run_lengths[code_length_order[k]], 3);
+                for (const length_run& r : runs) {
+                    writer.put(run_codes[r.symbol], run_lengths[r.symbol]);
+                    if (run_extra_bits(r.symbol)) writer.put(r.extra, run_extra_bits(r.symbol));
+                }
+            }
+
+            for (const token& t : tokens) {
+                if (t.distance == 0) {
+                    writer.put(literal_codes[t.length_or_literal], lit_len[t.length_or_literal]);
+                    continue;
+                }
+                const int lc = length_code(t.length_or_literal), dc = distance_code(t.distance);
+                writer.put(literal_codes[257 + lc], lit_len[257 + lc]);
+                if (length_extra[lc]) writer.put(t.length_or_literal - length_base[lc], length_extra[lc]);
+                writer.put(distance_codes[dc], dist_len[dc]);
+                if (distance_extra[dc]) writer.put(t.distance - distance_base[dc], distance_extra[dc]);
+            }
+            writer.put(literal_codes[256], lit_len[256]);
+        }
+    }
+
+    if (!last) {
+        // Sync flush: an empty non-final stored block.
+        writer.put(0, 3);
+        writer.align();
+        writer.put(0x0000, 16);
+        writer.put(0xffff, 16);
+    }
+    writer.align();
+}
+
+inline int paeth(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/*
+ * Filters one RGB row into `out` (filter byte then 3 * width bytes), trying all five PNG filters and keeping the one
+ * with the smallest sum of absolute signed residuals. `above` is null for the first row of the image.
+ */
+inline void filter_row(const unsigned char* row, const unsigned char* above, int width, unsigned char* out,
+                       std::vector<unsigned char>& scratch) {
+    const std::size_t n = static_cast<std::size_t>(width) * 3;
+    scratch.resize(n);
+    std::uint64_t best_cost = ~std::uint64_t(0);
+
+    for (int filter = 0; filter < 5; filter++) {
+        if (!above && (filter == 2 || filter == 4)) continue;  // Same as Sub or None on the first row
+        std::uint64_t cost = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            const int a = i >= 3 ? row[i - 3] : 0;
+            const int b = above ? above[i] : 0;
+            const int c = above && i >= 3 ? above[i - 3] : 0;
+            int predicted = 0;
+            switch (filter) {
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) >> 1; break;
+                case 4: predicted = paeth(a, b, c); break;
+                default: break;
+            }
+            const unsigned char residual = static_cast<unsigned char>(row[i] - predicted);
+            scratch[i] = residual;
+            cost += residual < 128 ? residual : 256 - residual;
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            out[0] = static_cast<unsigned char>(filter);
+            std::copy(scratch.begin(), scratch.end(), out + 1);
+        }
+    }
+}
+
+inline void put_u32(std::vector<unsigned char>& out, std::uint32_t v) {
+    out.push_back(static_cast<unsigned char>(v >> 24));
+    out.push_back(static_cast<unsigned char>(v >> 16));
+    out.push_back(static_cast<unsigned char>(v >> 8));
+    out.push_back(static_cast<unsigned char>(v));
+}
+
+// Wraps `data` as a chunk of `type`: length, type, data, CRC of type and data.
+inline void write_chunk(std::ostream& out, const char* type, const unsigned char* data, std::size_t size) {
+    std::vector<unsigned char> head;
+    put_u32(head, static_cast<std::uint32_t>(size));
+    head.insert(head.end(), type, type + 4);
+    std::uint32_t crc = crc32(0, head.data() + 4, 4);
+    crc = crc32(crc, data, size);
+    std::vector<unsigned char> tail;
+    put_u32(tail, crc);
+    out.write(reinterpret_cast<const char*>(head.data()), 8);
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    out.write(reinterpret_cast<const char*>(tail.data()), 4);
+}
+
+}  // namespace png_detail
+
+/*
+ * Writes a width x height 8-bit RGB PNG. rows(y, out) fills image row y (3 * width bytes); it is called from several
+ * threads at once, for rows in no particular order, and each row of a strip is requested together with the one above
+ * it. rows_done(y) runs on the calling thread once every row before y has been encoded and written.
+ */
+template <typename RowSource, typename RowsDone>
+void encode_png(std::ostream& out, int width, int height, RowSource&& rows, RowsDone&& rows_done,
+                unsigned threads = 0, int strip_rows = 64) {
+    using namespace png_detail;
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.write(reinterpret_cast<const char*>(signature), 8);
+    std::vector<unsigned char> header;
+    put_u32(header, static_cast<std::uint32_t>(width));
+    put_u32(header, static_cast<std::uint32_t>(height));
+    header.insert(header.end(), {8, 2, 0, 0, 0});  // 8-bit RGB, deflate, adaptive filtering, no interlace
+    write_chunk(out, "IHDR", header.data(), header.size());
+
+    const std::size_t row_bytes = static_cast<std::size_t>(width) * 3;
+    const int strip_count = (height + strip_rows - 1) / strip_rows;
+    const unsigned workers = worker_count(threads);
+    const int batch = static_cast<int>(workers) * 2;
+
+    struct strip_result {
+        std::vector<unsigned char> chunk;  // IDAT payload: zlib stream bytes of this strip
+        std::uint32_t adler = 1;
+        std::size_t raw_bytes = 0;
+    };
+    std::vector<strip_result> results(batch);
+    std::uint32_t adler = 1;
+
+    for (int first = 0; first < strip_count; first += batch) {
+        const int last = std::min(strip_count, first + batch);
+        std::atomic<int> next_strip{first};
+        parallel_workers(std::min<unsigned>(workers, static_cast<unsigned>(last - first)), [&](unsigned) {
+            std::vector<unsigned char> above(row_bytes), row(row_bytes), scratch;
+            for (int s = next_strip++; s < last; s = next_strip++) {
+                const int y0 = s * strip_rows, y1 = std::min(height, y0 + strip_rows);
+                std::vector<unsigned char> filtered(static_cast<std::size_t>(y1 - y0) * (row_bytes + 1));
+                if (y0 > 0) rows(y0 - 1, above.data());
+                for (int y = y0; y < y1; y++) {
+                    rows(y, row.data());
+                    filter_row(row.data(), y > 0 ? above.data() : nullptr, width,
+                               &filtered[static_cast<std::size_t>(y - y0) * (row_bytes + 1)], scratch);
+                    std::swap(row, above);
+                }
+
+                strip_result& result = results[s - first];
+                result.chunk.clear();
+                if (s == 0) result.chunk.insert(result.chunk.end(), {0x78, 0x9c});  // zlib header, 32 KiB window
+                deflate_strip(filtered.data(), filtered.size(), s == strip_count - 1, result.chunk);
+                result.adler = adler32(1, filtered.data(), filtered.size());
+                result.raw_bytes = filtered.size();
+            }
+        });
+
+        for (int s = first; s < last; s++) {
+            const strip_result& result = results[s - first];
+            write_chunk(out, "IDAT", result.chunk.data(), result.chunk.size());
+            adler = s == 0 ? result.adler : adler32_combine(adler, result.adler, result.raw_bytes);
+        }
+        rows_done(std::min(height, last * strip_rows));
+    }
+
+    std::vector<unsigned char> trailer;
+    put_u32(trailer, adler);
+    write_chunk(out, "IDAT", trailer.data(), trailer.size());
+    write_chunk(out, "IEND", nullptr, 0);
+}
+
+#endif
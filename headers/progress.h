@@ -0,0 +1,215 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <algorithm>           // For clamping utilization.
+#include <atomic>              // For the per-worker counters.
+#include <chrono>              // For elapsed time.
+#include <condition_variable>  // For waking the reporter early on finish.
+#include <cstdint>             // For counters.
+#include <cstdio>              // For formatting report lines.
+#include <memory>              // For the worker slots.
+#include <mutex>               // For the reporter's wait.
+#include <ostream>             // For the report stream.
+#include <string>              // For report lines.
+#include <thread>              // For the reporter thread.
+
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Render progress, counted by the workers and reported by a thread of its own.
+ * Each worker owns a cache-line-sized slot of relaxed atomic counters (work units done, rays traced) that only it
+ * writes, so the hot path costs a few uncontended stores per tile and never touches a stream. Every `interval` seconds
+ * the reporter sums the slots and rewrites one status line with the completed fraction, ETA, the ray rate over the
+ * last interval and each worker's utilization: the share of that interval it spent on a CPU, read from the worker's
+ * thread CPU clock, so waiting and preemption both show.
+ */
+class progress_reporter {
+private:
+    using clock = std::chrono::steady_clock;
+
+    enum worker_state { not_started, running, stopped };
+
+    struct alignas(64) worker_slot {
+        std::atomic<std::uint64_t> work{0};
+        std::atomic<std::uint64_t> rays{0};
+        std::atomic<int> state{not_started};
+        clockid_t cpu_clock;                        // Valid while running
+        std::int64_t start_cpu_ns = 0;              // Thread CPU time at begin_worker
+        std::atomic<std::int64_t> final_cpu_ns{0};  // CPU time used by end_worker
+    };
+
+    // Counter totals at one instant, for differencing between reports.
+    struct snapshot {
+        std::int64_t at_ns = 0;
+        std::uint64_t work = 0;
+        std::uint64_t rays = 0;
+        std::unique_ptr<std::int64_t[]> cpu_ns;
+    };
+
+    const std::uint64_t total_work;
+    const unsigned workers;
+    const std::chrono::duration<double> interval;
+    std::ostream& out;
+    const clock::time_point start = clock::now();
+    std::unique_ptr<worker_slot[]> slots;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool finishing = false;
+    std::thread reporter;
+    std::size_t line_length = 0;  // Of the status line on screen, 0 if none
+
+    std::int64_t now_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+    }
+
+    static bool read_clock(clockid_t id, std::int64_t& ns) {
+        timespec ts;
+        if (::clock_gettime(id, &ts) != 0) return false;
+        ns = static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        return true;
+    }
+
+    // CPU time worker w has used since begin_worker.
+    std::int64_t worker_cpu_ns(const worker_slot& slot) const {
+        switch (slot.state.load(std::memory_order_acquire)) {
+        case running: {
+            std::int64_t ns;
+            if (read_clock(slot.cpu_clock, ns)) return ns - slot.start_cpu_ns;
+            // The worker is just exiting; its final time follows shortly.
+            return slot.state.load(std::memory_order_acquire) == stopped ? slot.final_cpu_ns.load() : 0;
+        }
+        case stopped:
+            return slot.final_cpu_ns.load(std::memory_order_relaxed);
+        default:
+            return 0;
+        }
+    }
+
+    snapshot take_snapshot() const {
+        snapshot s;
+        s.at_ns = now_ns();
+        s.cpu_ns.reset(new std::int64_t[workers]);
+        for (unsigned w = 0; w < workers; w++) {
+            const worker_slot& slot = slots[w];
+            s.work += slot.work.load(std::memory_order_relaxed);
+            s.rays += slot.rays.load(std::memory_order_relaxed);
+            s.cpu_ns[w] = worker_cpu_ns(slot);
+        }
+        return s;
+    }
+
+    static std::string format_duration(double seconds) {
+        const long total = static_cast<long>(seconds + 0.5);
+        char text[32];
+        if (total >= 3600) {
+            std::snprintf(text, sizeof(text), "%ld:%02ld:%02ld", total / 3600, total / 60 % 60, total % 60);
+        } else {
+            std::snprintf(text, sizeof(text), "%ld:%02ld", total / 60, total % 60);
+        }
+        return text;
+    }
+
+    // Overwrites the status line, padding over whatever the previous one left behind.
+    void show(const std::string& line) {
+        out << '\r' << line;
+        if (line.size() < line_length) out << std::string(line_length - line.size(), ' ');
+        out << std::flush;
+        line_length = line.size();
+    }
+
+    void report(const snapshot& previous, const snapshot& current) {
+        const double elapsed = current.at_ns * 1e-9;
+        const double span = (current.at_ns - previous.at_ns) * 1e-9;
+        const double fraction = total_work ? static_cast<double>(current.work) / total_work : 1.0;
+
+        char text[96];
+        std::snprintf(text, sizeof(text), "Progress %5.1f%%  ETA ", 100.0 * fraction);
+        std::string line = text;
+        line += current.work ? format_duration(elapsed * (1.0 - fraction) / fraction) : std::string("--:--");
+        std::snprintf(text, sizeof(text), "  %.2f Mrays/s  utilization",
+                      span > 0 ? (current.rays - previous.rays) / span * 1e-6 : 0.0);
+        line += text;
+        for (unsigned w = 0; w < workers; w++) {
+            const double busy = span > 0 ? (current.cpu_ns[w] - previous.cpu_ns[w]) * 1e-9 / span : 0.0;
+            std::snprintf(text, sizeof(text), " %3.0f%%", 100.0 * std::min(1.0, std::max(0.0, busy)));
+            line += text;
+        }
+        show(line);
+    }
+
+    void run() {
+        snapshot previous = take_snapshot();
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [this] { return finishing; })) {
+            snapshot current = take_snapshot();
+            report(previous, current);
+            previous = std::move(current);
+        }
+    }
+
+public:
+    // Reports progress towards `total_work` units to `out` every `interval_seconds`; 0 or less only counts.
+    progress_reporter(std::uint64_t total_work, unsigned workers, double interval_seconds, std::ostream& out)
+        : total_work(total_work), workers(workers > 0 ? workers : 1), interval(interval_seconds), out(out),
+          slots(new worker_slot[workers > 0 ? workers : 1]) {
+        if (interval_seconds > 0) reporter = std::thread([this] { run(); });
+    }
+
+    ~progress_reporter() { finish(); }
+
+    progress_reporter(const progress_reporter&) = delete;
+    progress_reporter& operator=(const progress_reporter&) = delete;
+
+    // The calling thread works as worker w until end_worker(w); its CPU time counts towards w's utilization.
+    void begin_worker(unsigned w) {
+        worker_slot& slot = slots[w];
+        if (::pthread_getcpuclockid(::pthread_self(), &slot.cpu_clock) != 0 ||
+            !read_clock(slot.cpu_clock, slot.start_cpu_ns)) {
+            return;
+        }
+        slot.state.store(running, std::memory_order_release);
+    }
+
+    void end_worker(unsigned w) {
+        worker_slot& slot = slots[w];
+        std::int64_t ns;
+        if (slot.state.load(std::memory_order_relaxed) != running || !read_clock(slot.cpu_clock, ns)) return;
+        slot.final_cpu_ns.store(ns - slot.start_cpu_ns, std::memory_order_relaxed);
+        slot.state.store(stopped, std::memory_order_release);
+    }
+
+    // Worker w finished `work` units, having traced `rays` rays. Only worker w updates its slot, so plain relaxed
+    // loads and stores suffice; no read-modify-write.
+    void add_work(unsigned w, std::uint64_t work, std::uint64_t rays) {
+        worker_slot& slot = slots[w];
+        slot.work.store(slot.work.load(std::memory_order_relaxed) + work, std::memory_order_relaxed);
+        slot.rays.store(slot.rays.load(std::memory_order_relaxed) + rays, std::memory_order_relaxed);
+    }
+
+    // Stops the reporter; if it showed a status line, replaces it with a summary of the whole run. Idempotent.
+    void finish() {
+        if (!reporter.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishing = true;
+        }
+        wake.notify_one();
+        reporter.join();
+        if (line_length == 0) return;
+
+        const snapshot final_counts = take_snapshot();
+        const double elapsed = final_counts.at_ns * 1e-9;
+        double busy = 0;
+        for (unsigned w = 0; w < workers; w++) busy += final_counts.cpu_ns[w] * 1e-9;
+        char text[96];
+        std::snprintf(text, sizeof(text), "Done in %s  %.2f Mrays/s  mean utilization %.0f%%",
+                      format_duration(elapsed).c_str(), elapsed > 0 ? final_counts.rays / elapsed * 1e-6 : 0.0,
+                      elapsed > 0 ? 100.0 * busy / (elapsed * workers) : 0.0);
+        show(text);
+        out << '\n';
+    }
+};
+
+#endif
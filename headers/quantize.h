@@ -0,0 +1,93 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "rtweekend.h"
+
+#include <cstddef>  // For std::size_t.
+#include <vector>   // For the threshold table.
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Conversion of linear colors to 8-bit gamma-2 output bytes, a whole row at a time.
+ * Without dithering the result is bit-for-bit what write_color prints: sqrt of the positive part, clamped to
+ * [0, 0.999], times 255, truncated. The SSE2 path runs the same IEEE operations two channels at a time, so it is exact
+ * too. Ordered dithering adds an 8x8 Bayer threshold in [0, 1) before truncating, which turns the truncation's
+ * half-level darkening and banding in smooth gradients into a fine, unbiased pattern.
+ */
+
+enum class dither_mode { none, ordered };
+
+namespace quantize_detail {
+
+static_assert(sizeof(color) == 3 * sizeof(double), "rows are read as packed doubles");
+
+// Bayer thresholds (k + 0.5) / 64, row-major by (y mod 8, x mod 8).
+inline const double* bayer_thresholds() {
+    static const auto table = [] {
+        std::vector<double> t(64);
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) {
+                // The lowest coordinate bits pick the most significant quarter, as in the recursive construction.
+                int k = 0;
+                for (int bit = 0; bit < 3; bit++) {
+                    const int bx = (x >> bit) & 1, by = (y >> bit) & 1;
+                    k = k * 4 + ((bx ^ by) << 1 | by);
+                }
+                t[y * 8 + x] = (k + 0.5) / 64;
+            }
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+inline double gamma_clamped(double linear) {
+    static const interval intensity(0.000, 0.999);
+    return intensity.clamp(linear_to_gamma(linear));
+}
+
+}  // namespace quantize_detail
+
+// One channel exactly as write_color converts it, plus a dither threshold in [0, 1).
+inline unsigned char quantize_channel(double linear, double threshold = 0) {
+    return static_cast<unsigned char>(255 * quantize_detail::gamma_clamped(linear) + threshold);
+}
+
+// 8-bit bytes of image row y, three per pixel.
+inline void quantize_row(const color* row, int width, unsigned char* out, int y = 0,
+                         dither_mode dither = dither_mode::none) {
+    const double* in = reinterpret_cast<const double*>(row);
+    const std::size_t n = static_cast<std::size_t>(width) * 3;
+
+    // Per-element thresholds repeat every 8 pixels = 24 channels.
+    double pattern[24] = {0};
+    if (dither == dither_mode::ordered) {
+        const double* bayer = quantize_detail::bayer_thresholds() + (y & 7) * 8;
+        for (int k = 0; k < 24; k++) pattern[k] = bayer[k / 3];
+    }
+
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d top = _mm_set1_pd(0.999);
+    const __m128d scale = _mm_set1_pd(255.0);
+    auto lanes = [&](std::size_t i) {
+        // maxpd returns its second operand for NaN, so NaN and negatives become 0 as in linear_to_gamma.
+        __m128d g = _mm_min_pd(_mm_sqrt_pd(_mm_max_pd(_mm_loadu_pd(in + i), zero)), top);
+        return _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(g, scale), _mm_loadu_pd(pattern + i % 24)));
+    };
+    for (; k + 8 <= n; k += 8) {
+        // Eight channels: four pairs of int32, packed down to bytes.
+        __m128i low = _mm_unpacklo_epi64(lanes(k), lanes(k + 2));
+        __m128i high = _mm_unpacklo_epi64(lanes(k + 4), lanes(k + 6));
+        __m128i words = _mm_packs_epi32(low, high);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + k), _mm_packus_epi16(words, words));
+    }
+#endif
+    for (; k < n; k++) out[k] = quantize_channel(in[k], pattern[k % 24]);
+}
+
+#endif
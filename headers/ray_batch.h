@@ -0,0 +1,162 @@
+#ifndef RAY_BATCH_H
+#define RAY_BATCH_H
+
+#include "rtweekend.h"
+#include "bvh_build.h"
+#include "compiled_scene.h"
+#include "hittable.h"
+#include "parallel.h"
+#include "wide_bvh.h"
+
+#include <cstdint>  // For primitive ids and occlusion flags.
+#include <limits>   // For the miss distance.
+#include <vector>   // For the non-sphere objects.
+
+/*
+ * Batch of rays in structure-of-arrays form, as external callers usually hold them: one array per component, all
+ * `count` long (below 2^32). Directions need not be normalized; distances are in units of the direction's length, as
+ * for ray. Both queries test the open interval (tmin, tmax), as interval::surrounds does: a hit exactly at tmin or
+ * tmax is not reported.
+ */
+struct ray_batch {
+    const double* origin_x;
+    const double* origin_y;
+    const double* origin_z;
+    const double* dir_x;
+    const double* dir_y;
+    const double* dir_z;
+    const double* tmin;
+    const double* tmax;
+    std::size_t count;
+
+    ray get(std::size_t i) const {
+        return ray(point3(origin_x[i], origin_y[i], origin_z[i]), vec3(dir_x[i], dir_y[i], dir_z[i]));
+    }
+};
+
+// Primitive id reported for rays that hit nothing.
+constexpr std::uint32_t ray_batch_miss = std::numeric_limits<std::uint32_t>::max();
+
+/*
+ * Per-ray results, caller-owned and at least `count` long. Misses get t = infinity and ray_batch_miss. Normals are the
+ * outward geometric normals, not flipped toward the ray; leave the normal pointers null to skip computing them.
+ */
+struct hit_batch {
+    double* t;
+    std::uint32_t* primitive_id;
+    double* normal_x = nullptr;
+    double* normal_y = nullptr;
+    double* normal_z = nullptr;
+};
+
+/*
+ * Geometry-only query engine for callers that need visibility and distances rather than images.
+ * Owns a wide BVH over a compiled scene and answers whole batches: rays are split across worker threads and each one
+ * walks the SIMD node layout directly, so no hit_record, material lookup or virtual call is paid per ray. Once the
+ * nodes outgrow the caches, a batch is first put in (direction octant, origin Morton code) order so neighbouring rays
+ * touch the same nodes; results still land at each ray's own index.
+ * Primitive ids are sphere indices in the compiled scene; objects that are not spheres follow as
+ * spheres().size() + their index in others().
+ */
+template <int N = 4>
+class ray_batch_caster {
+private:
+    wide_bvh<N> accel;
+    std::vector<shared_ptr<hittable>> other_objects;
+    unsigned threads;
+
+    static constexpr std::size_t grain = 1024;
+    static constexpr std::size_t sort_min_rays = 4096;
+    static constexpr std::size_t sort_min_node_bytes = std::size_t(1) << 20;
+
+    /*
+     * Trace order for a batch: keys hold the ray index in their low 32 bits, sorted by a 3-bit direction octant over a
+     * 27-bit Morton code of the origin within the scene bounds. Empty when the batch is too small or the tree fits in
+     * cache, in which case rays run in input order.
+     */
+    std::vector<std::uint64_t> ray_order(const ray_batch& rays) const {
+        std::vector<std::uint64_t> keys;
+        if (rays.count < sort_min_rays || accel.node_bytes() < sort_min_node_bytes) return keys;
+
+        const aabb box = accel.bounding_box();
+        auto extent = [](const interval& ax) { return ax.size() > 0 ? 1.0 / ax.size() : 0.0; };
+        const double sx = extent(box.x), sy = extent(box.y), sz = extent(box.z);
+
+        keys.resize(rays.count);
+        parallel_for(rays.count, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                std::uint64_t code = lbvh_detail::morton3((rays.origin_x[i] - box.x.min) * sx,
+                                                          (rays.origin_y[i] - box.y.min) * sy,
+                                                          (rays.origin_z[i] - box.z.min) * sz) >> 3;
+                std::uint64_t octant = (rays.dir_x[i] < 0) | (rays.dir_y[i] < 0) << 1 | (rays.dir_z[i] < 0) << 2;
+                keys[i] = (((octant << 27) | code) << 32) | i;
+            }
+        }, threads, grain);
+        lbvh_detail::radix_sort(keys, 4, 8, threads);
+        return keys;
+    }
+
+public:
+    explicit ray_batch_caster(const compiled_scene& scene, unsigned threads = 0)
+        : accel(scene, bvh_builder::binned_sah, threads), other_objects(scene.others()), threads(threads) {}
+
+    std::size_t primitive_count() const { return accel.primitive_count() + other_objects.size(); }
+
+    // Closest hit within (tmin, tmax) for every ray in the batch.
+    void intersect(const ray_batch& rays, const hit_batch& hits) const {
+        const sphere_view spheres = accel.spheres().view();
+        const auto& nodes = accel.node_array();
+        const std::vector<std::uint32_t>& ids = accel.primitive_ids();
+        const std::uint32_t other_base = static_cast<std::uint32_t>(spheres.size());
+        const bool want_normals = hits.normal_x && hits.normal_y && hits.normal_z;
+        const std::vector<std::uint64_t> order = ray_order(rays);
+
+        parallel_for(rays.count, [&](std::size_t begin, std::size_t end) {
+            hit_record rec;
+            for (std::size_t k = begin; k < end; k++) {
+                const std::size_t i = order.empty() ? k : static_cast<std::size_t>(order[k] & 0xFFFFFFFFu);
+                const ray r = rays.get(i);
+                const interval ray_t(rays.tmin[i], rays.tmax[i]);
+
+                double closest_so_far = ray_t.max;
+                std::size_t slot =
+                    traverse_wide<N, false>(nodes.data(), nodes.size(), spheres, r, ray_t, closest_so_far, nullptr);
+                std::uint32_t id = slot < spheres.size() ? ids[slot] : ray_batch_miss;
+                vec3 normal;
+                if (want_normals && id != ray_batch_miss) {
+                    normal = (r.at(closest_so_far) - spheres.center(slot)) / spheres.radius[slot];
+                }
+
+                for (std::size_t j = 0; j < other_objects.size(); j++) {
+                    if (other_objects[j]->hit(r, interval(ray_t.min, closest_so_far), rec)) {
+                        closest_so_far = rec.t;
+                        id = other_base + static_cast<std::uint32_t>(j);
+                        normal = rec.front_face ? rec.normal : -rec.normal;
+                    }
+                }
+
+                hits.t[i] = id != ray_batch_miss ? closest_so_far : infinity;
+                hits.primitive_id[i] = id;
+                if (want_normals) {
+                    hits.normal_x[i] = normal.x();
+                    hits.normal_y[i] = normal.y();
+                    hits.normal_z[i] = normal.z();
+                }
+            }
+        }, threads, grain);
+    }
+
+    // Any-hit visibility for every ray: blocked[i] is 1 if anything lies within (tmin, tmax), else 0.
+    void occluded(const ray_batch& rays, std::uint8_t* blocked) const {
+        const std::vector<std::uint64_t> order = ray_order(rays);
+
+        parallel_for(rays.count, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin; k < end; k++) {
+                const std::size_t i = order.empty() ? k : static_cast<std::size_t>(order[k] & 0xFFFFFFFFu);
+                blocked[i] = accel.occluded(rays.get(i), interval(rays.tmin[i], rays.tmax[i])) ? 1 : 0;
+            }
+        }, threads, grain);
+    }
+};
+
+#endif
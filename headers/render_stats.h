@@ -0,0 +1,102 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <cstdint>  // For the counters.
+#include <mutex>    // For merging worker counters.
+#include <ostream>  // For the JSON summary.
+
+/*
+ * Per-render ray statistics, compiled in with -DRT_ENABLE_STATS (make STATS=1).
+ * Hot code bumps counters with RT_STAT(name), which increments a field of a thread-local render_stats, so workers never
+ * share a cache line; the camera merges each worker's counters when it finishes and prints a JSON summary. Without
+ * RT_ENABLE_STATS, RT_STAT expands to nothing and the collector's members are empty, so instrumented code compiles to
+ * exactly what it was.
+ */
+struct render_stats {
+    std::uint64_t primary_rays = 0;                // Camera rays traced
+    std::uint64_t secondary_rays = 0;              // Scattered rays traced
+    std::uint64_t intersection_tests = 0;          // Ray/primitive tests
+    std::uint64_t hits = 0;                        // Traced rays that hit the scene
+    std::uint64_t misses = 0;                      // Traced rays that escaped to the background
+    std::uint64_t absorptions = 0;                 // Hits whose material scattered nothing
+    std::uint64_t metal_rejections = 0;            // Fuzzed metal reflections below the surface (also absorptions)
+    std::uint64_t total_internal_reflections = 0;  // Dielectric hits that could not refract
+    std::uint64_t depth_cutoffs = 0;               // Paths ended by max_depth
+
+    render_stats& operator+=(const render_stats& other) {
+        primary_rays += other.primary_rays;
+        secondary_rays += other.secondary_rays;
+        intersection_tests += other.intersection_tests;
+        hits += other.hits;
+        misses += other.misses;
+        absorptions += other.absorptions;
+        metal_rejections += other.metal_rejections;
+        total_internal_reflections += other.total_internal_reflections;
+        depth_cutoffs += other.depth_cutoffs;
+        return *this;
+    }
+
+    void write_json(std::ostream& out) const {
+        const std::uint64_t rays = primary_rays + secondary_rays;
+        out << "{\"primary_rays\": " << primary_rays << ", \"secondary_rays\": " << secondary_rays
+            << ", \"intersection_tests\": " << intersection_tests << ", \"hits\": " << hits
+            << ", \"misses\": " << misses << ", \"absorptions\": " << absorptions
+            << ", \"metal_rejections\": " << metal_rejections
+            << ", \"total_internal_reflections\": " << total_internal_reflections
+            << ", \"depth_cutoffs\": " << depth_cutoffs
+            << ", \"rays_per_path\": " << (primary_rays ? static_cast<double>(rays) / primary_rays : 0.0)
+            << ", \"tests_per_ray\": " << (rays ? static_cast<double>(intersection_tests) / rays : 0.0) << "}\n";
+    }
+};
+
+#if defined(RT_ENABLE_STATS)
+
+namespace stats_detail {
+inline thread_local render_stats counters;
+}  // namespace stats_detail
+
+#define RT_STAT(name) (++stats_detail::counters.name)
+
+// Returns the calling thread's counters and zeroes them.
+inline render_stats take_thread_stats() {
+    render_stats taken = stats_detail::counters;
+    stats_detail::counters = render_stats();
+    return taken;
+}
+
+#else
+
+#define RT_STAT(name) ((void)0)
+
+inline render_stats take_thread_stats() { return render_stats(); }
+
+#endif
+
+// Sums the counters of a render's workers; each worker calls begin_worker() and end_worker() around its share.
+class render_stats_collector {
+private:
+#if defined(RT_ENABLE_STATS)
+    std::mutex mutex;
+    render_stats total;
+#endif
+
+public:
+#if defined(RT_ENABLE_STATS)
+    // Drops whatever the thread counted before, e.g. while building the scene.
+    void begin_worker() { take_thread_stats(); }
+
+    void end_worker() {
+        const render_stats mine = take_thread_stats();
+        std::lock_guard<std::mutex> lock(mutex);
+        total += mine;
+    }
+
+    void report(std::ostream& out) const { total.write_json(out); }
+#else
+    void begin_worker() {}
+    void end_worker() {}
+    void report(std::ostream&) const {}
+#endif
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
@@ -24,8 +25,39 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+/*
+ * Per-thread sample generator (splitmix64).
+ * Render workers install one per tile with scoped_sample_rng, so images do not depend on thread scheduling and shading
+ * never contends on std::rand; everywhere else random_double() keeps drawing from std::rand, so seeded scenes are
+ * unchanged.
+ */
+struct sample_rng {
+	std::uint64_t state;
+
+	double next() {
+		std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		z ^= z >> 31;
+		return (z >> 11) * 0x1.0p-53;
+	}
+};
+
+inline thread_local sample_rng* active_sample_rng = nullptr;
+
+struct scoped_sample_rng {
+	sample_rng rng;
+
+	explicit scoped_sample_rng(std::uint64_t seed) : rng{seed} { active_sample_rng = &rng; }
+	~scoped_sample_rng() { active_sample_rng = nullptr; }
+
+	scoped_sample_rng(const scoped_sample_rng&) = delete;
+	scoped_sample_rng& operator=(const scoped_sample_rng&) = delete;
+};
+
 inline double random_double() {
 	// Returns a random real in [0,1).
+	if (active_sample_rng) return active_sample_rng->next();
 	return std::rand() / (RAND_MAX + 1.0);
 }
 
@@ -0,0 +1,353 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "compiled_scene.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <cmath>          // For finiteness checks.
+#include <cstdint>        // For the fixed-width records.
+#include <cstring>        // For the magic.
+#include <istream>        // For reading text scenes.
+#include <sstream>        // For tokenizing text scene lines.
+#include <string>         // For paths, names and errors.
+#include <unordered_map>  // For material names and recorded material identities.
+#include <vector>         // For the material table.
+
+/*
+ * Material record: the concrete type plus its constructor arguments, so loading builds exactly the object the scene
+ * code would have built.
+ */
+enum class scene_material_kind : std::uint32_t { lambertian = 0, metal = 1, dielectric = 2 };
+
+struct scene_material_record {
+    scene_material_kind kind;
+    std::uint32_t reserved;
+    double params[4];  // Lambertian: albedo rgb; metal: albedo rgb, fuzz; dielectric: refraction index
+
+    shared_ptr<material> make() const {
+        switch (kind) {
+        case scene_material_kind::lambertian:
+            return make_shared<lambertian>(color(params[0], params[1], params[2]));
+        case scene_material_kind::metal:
+            return make_shared<metal>(color(params[0], params[1], params[2]), params[3]);
+        case scene_material_kind::dielectric:
+            return make_shared<dielectric>(params[0]);
+        }
+        return nullptr;
+    }
+};
+
+// Camera block: the public camera settings, field for field.
+struct scene_camera_record {
+    double aspect_ratio;
+    std::int32_t image_width;
+    std::int32_t samples_per_pixel;
+    std::int32_t max_depth;
+    std::int32_t reserved;
+    double vfov;
+    double lookfrom[3];
+    double lookat[3];
+    double vup[3];
+    double defocus_angle;
+    double focus_dist;
+
+    static scene_camera_record from(const camera& cam) {
+        scene_camera_record rec{};
+        rec.aspect_ratio = cam.aspect_ratio;
+        rec.image_width = cam.image_width;
+        rec.samples_per_pixel = cam.samples_per_pixel;
+        rec.max_depth = cam.max_depth;
+        rec.vfov = cam.vfov;
+        for (int axis = 0; axis < 3; axis++) {
+            rec.lookfrom[axis] = cam.lookfrom[axis];
+            rec.lookat[axis] = cam.lookat[axis];
+            rec.vup[axis] = cam.vup[axis];
+        }
+        rec.defocus_angle = cam.defocus_angle;
+        rec.focus_dist = cam.focus_dist;
+        return rec;
+    }
+
+    // Settings a camera can render with; anything else would divide by zero or render nothing.
+    bool renderable() const {
+        return image_width > 0 && aspect_ratio > 0 && std::isfinite(aspect_ratio) && samples_per_pixel > 0 &&
+               max_depth >= 0;
+    }
+
+    void apply(camera& cam) const {
+        cam.aspect_ratio = aspect_ratio;
+        cam.image_width = image_width;
+        cam.samples_per_pixel = samples_per_pixel;
+        cam.max_depth = max_depth;
+        cam.vfov = vfov;
+        cam.lookfrom = point3(lookfrom[0], lookfrom[1], lookfrom[2]);
+        cam.lookat = point3(lookat[0], lookat[1], lookat[2]);
+        cam.vup = vec3(vup[0], vup[1], vup[2]);
+        cam.defocus_angle = defocus_angle;
+        cam.focus_dist = focus_dist;
+    }
+};
+
+// Sphere radii the SoA arrays accept as they are; the sphere constructor clamps, the compiled arrays do not.
+inline bool valid_sphere_radius(double radius) { return radius >= 0 && std::isfinite(radius); }
+
+/*
+ * Scene file layout, native endianness: this header, then the material records, the camera block and the five sphere
+ * arrays as mapped_file.h sections. Loading is a mapping plus bounds checks; nothing is parsed.
+ * Bump scene_file_version whenever a record layout changes.
+ */
+constexpr char scene_file_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '1'};
+constexpr std::uint32_t scene_file_version = 1;
+
+struct scene_file_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t sphere_count;
+    std::uint64_t material_count;
+    std::uint64_t section_offset[7];  // Materials, camera, center x/y/z, radius, material ids
+    std::uint64_t file_size;
+};
+
+/*
+ * Authoring-side scene: what a scene file holds, in owned memory. Filled by the text parser or by scene_recorder, and
+ * written with write_scene_file().
+ */
+struct scene_description {
+    std::vector<scene_material_record> materials;
+    scene_camera_record camera_settings = scene_camera_record::from(camera());
+    sphere_soa spheres;
+};
+
+// Returns false if the file cannot be written.
+inline bool write_scene_file(const std::string& path, const scene_description& scene) {
+    const sphere_soa& spheres = scene.spheres;
+    const std::size_t n = spheres.size();
+
+    const void* sections[7] = {scene.materials.data(), &scene.camera_settings, spheres.center_x.data(),
+                               spheres.center_y.data(), spheres.center_z.data(), spheres.radius.data(),
+                               spheres.material_id.data()};
+    const std::uint64_t lengths[7] = {scene.materials.size() * sizeof(scene_material_record),
+                                      sizeof(scene_camera_record), n * sizeof(double), n * sizeof(double),
+                                      n * sizeof(double), n * sizeof(double), n * sizeof(std::uint32_t)};
+
+    scene_file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, scene_file_magic, sizeof(header.magic));
+    header.version = scene_file_version;
+    header.sphere_count = n;
+    header.material_count = scene.materials.size();
+    header.file_size = layout_sections(sizeof(header), lengths, 7, header.section_offset);
+
+    return write_section_file(path, &header, sizeof(header), sections, lengths, header.section_offset, 7,
+                              header.file_size);
+}
+
+/*
+ * Scene file opened with mmap.
+ * The sphere arrays are views into the mapping; only the (small) material table is turned into objects. valid() is
+ * false when the file is missing, truncated, of another version, references a material it does not contain, or holds
+ * camera settings or radii that cannot be rendered.
+ */
+class mapped_scene {
+private:
+    mapped_file file;
+    const scene_material_record* material_records = nullptr;
+    std::size_t material_total = 0;
+    const scene_camera_record* camera_block = nullptr;
+    sphere_view sphere_data{nullptr, nullptr, nullptr, nullptr, nullptr, 0};
+
+    bool validate() {
+        if (!file.is_open() || file.size() < sizeof(scene_file_header)) return false;
+        scene_file_header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, scene_file_magic, sizeof(header.magic)) != 0) return false;
+        if (header.version != scene_file_version || header.file_size != file.size()) return false;
+
+        const std::uint64_t n = header.sphere_count;
+        if (n > file.size() || header.material_count > file.size()) return false;
+        const std::uint64_t lengths[7] = {header.material_count * sizeof(scene_material_record),
+                                          sizeof(scene_camera_record), n * sizeof(double), n * sizeof(double),
+                                          n * sizeof(double), n * sizeof(double), n * sizeof(std::uint32_t)};
+        if (!sections_in_bounds(header.section_offset, lengths, 7, file.size())) return false;
+
+        auto section = [&](int s) { return file.data() + header.section_offset[s]; };
+        material_records = reinterpret_cast<const scene_material_record*>(section(0));
+        material_total = header.material_count;
+        camera_block = reinterpret_cast<const scene_camera_record*>(section(1));
+        sphere_data = {reinterpret_cast<const double*>(section(2)), reinterpret_cast<const double*>(section(3)),
+                       reinterpret_cast<const double*>(section(4)), reinterpret_cast<const double*>(section(5)),
+                       reinterpret_cast<const std::uint32_t*>(section(6)), n};
+
+        for (std::size_t m = 0; m < material_total; m++) {
+            if (static_cast<std::uint32_t>(material_records[m].kind) > 2) return false;
+        }
+        for (std::size_t i = 0; i < sphere_data.size(); i++) {
+            if (sphere_data.material_id[i] >= material_total) return false;
+            if (!valid_sphere_radius(sphere_data.radius[i])) return false;
+        }
+        return camera_block->renderable();
+    }
+
+public:
+    explicit mapped_scene(const std::string& path) : file(path) {
+        if (!validate()) file = mapped_file();
+    }
+
+    bool valid() const { return file.is_open(); }
+
+    const sphere_view& spheres() const { return sphere_data; }
+    const scene_camera_record& camera_settings() const { return *camera_block; }
+
+    std::vector<shared_ptr<material>> materials() const {
+        std::vector<shared_ptr<material>> table;
+        table.reserve(material_total);
+        for (std::size_t m = 0; m < material_total; m++) table.push_back(material_records[m].make());
+        return table;
+    }
+
+    // Compiled scene for the accelerators: one bulk copy per sphere array.
+    compiled_scene compile() const { return compiled_scene(sphere_data, materials()); }
+};
+
+/*
+ * Object factory that records what it builds.
+ * Wraps another factory (scene_arena, heap_factory or a material_registry) with the same make<T>() interface, so the
+ * scene builders in scenes.h can be exported to a scene file unchanged. Spheres must use materials made through the
+ * same recorder.
+ */
+template <typename Factory>
+class scene_recorder {
+private:
+    Factory& factory;
+    scene_description& scene;
+    std::unordered_map<const material*, std::uint32_t> material_ids;
+
+    void add_material(const material* m, scene_material_kind kind, double p0, double p1 = 0, double p2 = 0,
+                      double p3 = 0) {
+        // Interning factories hand out one object for equal requests; record it once.
+        if (material_ids.emplace(m, static_cast<std::uint32_t>(scene.materials.size())).second) {
+            scene.materials.push_back({kind, 0, {p0, p1, p2, p3}});
+        }
+    }
+
+    void note(const lambertian* m, const color& albedo) {
+        add_material(m, scene_material_kind::lambertian, albedo.x(), albedo.y(), albedo.z());
+    }
+    void note(const metal* m, const color& albedo, double fuzz) {
+        add_material(m, scene_material_kind::metal, albedo.x(), albedo.y(), albedo.z(), fuzz);
+    }
+    void note(const dielectric* m, double refraction_index) {
+        add_material(m, scene_material_kind::dielectric, refraction_index);
+    }
+    void note(const sphere*, const point3& center, double radius, const shared_ptr<material>& mat) {
+        scene.spheres.push_back(center, radius, material_ids.at(mat.get()));
+    }
+
+public:
+    scene_recorder(Factory& factory, scene_description& scene) : factory(factory), scene(scene) {}
+
+    template <typename T, typename... Args>
+    shared_ptr<T> make(const Args&... args) {
+        auto object = factory.template make<T>(args...);
+        note(object.get(), args...);
+        return object;
+    }
+};
+
+/*
+ * Text scene format, one statement per line; '#' starts a comment.
+ *   camera <setting> <value> ...      settings as named in camera, points and vectors as three numbers
+ *   material <name> lambertian <r> <g> <b>
+ *   material <name> metal <r> <g> <b> <fuzz>
+ *   material <name> dielectric <refraction index>
+ *   sphere <x> <y> <z> <radius> <material name>
+ * Materials must be declared before the spheres that use them. Returns false and sets `error` (with the line number)
+ * on malformed input.
+ */
+inline bool parse_scene_text(std::istream& in, scene_description& scene, std::string& error) {
+    std::unordered_map<std::string, std::uint32_t> material_names;
+    std::string line;
+    int line_number = 0;
+
+    auto fail = [&](const std::string& message) {
+        error = "line " + std::to_string(line_number) + ": " + message;
+        return false;
+    };
+
+    while (std::getline(in, line)) {
+        line_number++;
+        std::string::size_type comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::istringstream tokens(line);
+        std::string keyword;
+        if (!(tokens >> keyword)) continue;
+
+        if (keyword == "camera") {
+            scene_camera_record& cam = scene.camera_settings;
+            auto read = [&](auto& value) { return static_cast<bool>(tokens >> value); };
+            auto read3 = [&](double* v) { return static_cast<bool>(tokens >> v[0] >> v[1] >> v[2]); };
+            std::string setting;
+            while (tokens >> setting) {
+                bool ok;
+                if (setting == "aspect_ratio") ok = read(cam.aspect_ratio);
+                else if (setting == "image_width") ok = read(cam.image_width);
+                else if (setting == "samples_per_pixel") ok = read(cam.samples_per_pixel);
+                else if (setting == "max_depth") ok = read(cam.max_depth);
+                else if (setting == "vfov") ok = read(cam.vfov);
+                else if (setting == "lookfrom") ok = read3(cam.lookfrom);
+                else if (setting == "lookat") ok = read3(cam.lookat);
+                else if (setting == "vup") ok = read3(cam.vup);
+                else if (setting == "defocus_angle") ok = read(cam.defocus_angle);
+                else if (setting == "focus_dist") ok = read(cam.focus_dist);
+                else return fail("unknown camera setting '" + setting + "'");
+                if (!ok || !cam.renderable()) return fail("bad value for camera setting '" + setting + "'");
+            }
+        } else if (keyword == "material") {
+            std::string name, type;
+            if (!(tokens >> name >> type)) return fail("expected material <name> <type> ...");
+            scene_material_record rec{scene_material_kind::lambertian, 0, {0, 0, 0, 0}};
+            bool ok;
+            if (type == "lambertian") {
+                ok = static_cast<bool>(tokens >> rec.params[0] >> rec.params[1] >> rec.params[2]);
+            } else if (type == "metal") {
+                rec.kind = scene_material_kind::metal;
+                ok = static_cast<bool>(tokens >> rec.params[0] >> rec.params[1] >> rec.params[2] >> rec.params[3]);
+            } else if (type == "dielectric") {
+                rec.kind = scene_material_kind::dielectric;
+                ok = static_cast<bool>(tokens >> rec.params[0]);
+            } else {
+                return fail("unknown material type '" + type + "'");
+            }
+            if (!ok) return fail("bad parameters for material '" + name + "'");
+            if (!material_names.emplace(name, static_cast<std::uint32_t>(scene.materials.size())).second) {
+                return fail("material '" + name + "' declared twice");
+            }
+            scene.materials.push_back(rec);
+        } else if (keyword == "sphere") {
+            double x, y, z, radius;
+            std::string name;
+            if (!(tokens >> x >> y >> z >> radius >> name)) {
+                return fail("expected sphere <x> <y> <z> <radius> <material>");
+            }
+            if (!valid_sphere_radius(radius)) return fail("sphere radius must be finite and non-negative");
+            auto it = material_names.find(name);
+            if (it == material_names.end()) return fail("undeclared material '" + name + "'");
+            scene.spheres.push_back(point3(x, y, z), radius, it->second);
+        } else {
+            return fail("unknown statement '" + keyword + "'");
+        }
+
+        std::string extra;
+        if (tokens >> extra) return fail("unexpected '" + extra + "'");
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+
+/*
+ * Random spheres scene.
+ * The cover scene of the first book, shared by the renderer and the benchmark; templated on the object factory
+ * (scene_arena or heap_factory) so the same scene can be built with either allocation strategy.
+ * half_extent = 11 gives the original 22x22 grid of small spheres; larger values give big procedural scenes.
+ */
+template <typename Factory>
+void random_spheres_scene(hittable_list& world, Factory& factory, int half_extent = 11) {
+    world.reserve(world.objects.size() + 4 * half_extent * half_extent + 4);
+
+    auto ground_material = factory.template make<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(factory.template make<sphere>(point3(0,-1000,0), 1000, ground_material));
+
+    for (int a = -half_extent; a < half_extent; a++) {
+        for (int b = -half_extent; b < half_extent; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<material> sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    sphere_material = factory.template make<lambertian>(albedo);
+                    world.add(factory.template make<sphere>(center, 0.2, sphere_material));
+                } else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = factory.template make<metal>(albedo, fuzz);
+                    world.add(factory.template make<sphere>(center, 0.2, sphere_material));
+                } else {
+                    // glass
+                    sphere_material = factory.template make<dielectric>(1.5);
+                    world.add(factory.template make<sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = factory.template make<dielectric>(1.5);
+    world.add(factory.template make<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = factory.template make<lambertian>(color(0.4, 0.2, 0.1));
+    world.add(factory.template make<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = factory.template make<metal>(color(0.7, 0.6, 0.5), 0.0);
+    world.add(factory.template make<sphere>(point3(4, 1, 0), 1.0, material3));
+}
+
+// Camera for the random spheres scene, as on the cover of the first book.
+inline void random_spheres_camera(camera& cam) {
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 1200;
+    cam.samples_per_pixel = 500;
+    cam.max_depth         = 50;
+
+    cam.vfov     = 20;
+    cam.lookfrom = point3(13,2,3);
+    cam.lookat   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocus_angle = 0.6;
+    cam.focus_dist    = 10.0;
+}
+
+#endif
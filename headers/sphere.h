@@ -13,20 +13,11 @@ private:
     point3 center;
     double radius;
     shared_ptr<material> mat;
+    aabb bbox;
 
-public:
-    /*
-     * Constructor.
-     * Takes const ref for efficiency; clamps radius to non-negative for robustness against invalid inputs.
-     */
-    sphere(const point3& center, double radius, shared_ptr<material> mat) 
-	    : center(center), radius(std::fmax(0, radius)), mat(mat) {}
-
-    /*
-     * Intersection override.
-     * Uses optimized quadratic form (with h) for fewer operations and better numerical stability; computes only necessary roots to minimize sqrt calls.
-     */
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+    // Nearest root of the ray/sphere quadratic within ray_t, shared by the closest-hit and any-hit queries.
+    bool solve(const ray& r, interval ray_t, double& root) const {
+        RT_STAT(intersection_tests);
         vec3 oc = center - r.origin();
         auto a = r.direction().length_squared();
         auto h = dot(r.direction(), oc);
@@ -37,13 +28,41 @@ public:
         }
         auto sqrtd = std::sqrt(discriminant);
         // Prefers nearest root first for early closest-hit determination; checks interval to prune invalid intersections efficiently.
-        auto root = (h - sqrtd) / a;
+        root = (h - sqrtd) / a;
         if (!ray_t.surrounds(root)) {
             root = (h + sqrtd) / a;
             if (!ray_t.surrounds(root)) {
                 return false;
             }
         }
+        return true;
+    }
+
+public:
+    /*
+     * Constructor.
+     * Takes const ref for efficiency; clamps radius to non-negative for robustness against invalid inputs.
+     */
+    sphere(const point3& center, double radius, shared_ptr<material> mat) 
+	    : center(center), radius(std::fmax(0, radius)), mat(mat) {
+        auto rvec = vec3(this->radius, this->radius, this->radius);
+        bbox = aabb(center - rvec, center + rvec);
+    }
+
+    // Read-only accessors; used by scene compilation to copy geometry into flat arrays.
+    const point3& get_center() const { return center; }
+    double get_radius() const { return radius; }
+    const shared_ptr<material>& get_material() const { return mat; }
+
+    /*
+     * Intersection override.
+     * Uses optimized quadratic form (with h) for fewer operations and better numerical stability; computes only necessary roots to minimize sqrt calls.
+     */
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        double root;
+        if (!solve(r, ray_t, root)) {
+            return false;
+        }
         rec.t = root;
         rec.p = r.at(rec.t);
         vec3 outward_normal = (rec.p - center) / radius;
@@ -51,6 +70,13 @@ public:
 	rec.mat = mat;
         return true;
     }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        double root;
+        return solve(r, ray_t, root);
+    }
+
+    aabb bounding_box() const override { return bbox; }
 };
 
 #endif
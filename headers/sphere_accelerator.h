@@ -0,0 +1,88 @@
+#ifndef SPHERE_ACCELERATOR_H
+#define SPHERE_ACCELERATOR_H
+
+#include "rtweekend.h"
+#include "bvh_build.h"
+#include "compiled_scene.h"
+#include "hittable.h"
+
+#include <cstdint>  // For primitive ids.
+#include <vector>   // For ids, materials and fallback objects.
+
+/*
+ * Builds the record for the closest sphere slot (spheres.size() for none) and folds in the objects that are not spheres.
+ */
+inline bool finish_sphere_hit(const sphere_view& spheres, const std::vector<shared_ptr<material>>& materials,
+                              const std::vector<shared_ptr<hittable>>& others, const ray& r, interval ray_t,
+                              std::size_t closest, double closest_so_far, hit_record& rec) {
+    bool hit_anything = closest < spheres.size();
+    if (hit_anything) {
+        spheres.fill_record(r, closest, closest_so_far, materials, rec);
+    }
+
+    hit_record temp_rec;
+    for (const auto& object : others) {
+        if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+        }
+    }
+
+    return hit_anything;
+}
+
+// Any-hit counterpart for the objects that are not spheres.
+inline bool others_occluded(const std::vector<shared_ptr<hittable>>& others, const ray& r, interval ray_t) {
+    for (const auto& object : others) {
+        if (object->occluded(r, ray_t)) return true;
+    }
+    return false;
+}
+
+/*
+ * Common base for acceleration structures over a compiled scene.
+ * Owns the spheres in the structure's own order (plus each slot's original primitive id), the material table and the
+ * non-sphere objects. Derived classes only find the closest (slot, t); finish_hit() builds the record once and folds in
+ * the objects that are not spheres.
+ */
+class sphere_accelerator : public hittable {
+protected:
+    sphere_soa sphere_data;
+    std::vector<std::uint32_t> prim_ids;
+    std::vector<shared_ptr<material>> material_table;
+    std::vector<shared_ptr<hittable>> other_objects;
+    aabb bbox;
+
+    explicit sphere_accelerator(const compiled_scene& scene)
+        : material_table(scene.materials()), other_objects(scene.others()), bbox(scene.bounding_box()) {}
+
+    // Builds a tree over the scene's spheres and copies them into its leaf order.
+    bvh_build_tree build_tree(const compiled_scene& scene, bvh_builder builder, unsigned threads, int sah_bins) {
+        const sphere_soa& source = scene.spheres();
+
+        std::vector<aabb> bounds(source.size());
+        for (std::size_t i = 0; i < source.size(); i++) bounds[i] = source.bounds(i);
+
+        bvh_build_tree tree = build_bvh_tree(bounds, builder, threads, sah_bins);
+
+        prim_ids = tree.prim_order;
+        sphere_data.reserve(source.size());
+        for (auto id : prim_ids) sphere_data.push_back_from(source, id);
+        return tree;
+    }
+
+    bool finish_hit(const ray& r, interval ray_t, std::size_t closest, double closest_so_far, hit_record& rec) const {
+        return finish_sphere_hit(sphere_data.view(), material_table, other_objects, r, ray_t, closest, closest_so_far,
+                                 rec);
+    }
+
+public:
+    std::size_t primitive_count() const { return sphere_data.size(); }
+    const sphere_soa& spheres() const { return sphere_data; }
+    const std::vector<std::uint32_t>& primitive_ids() const { return prim_ids; }
+
+    aabb bounding_box() const override { return bbox; }
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef TILE_SINK_H
+#define TILE_SINK_H
+
+#include "rtweekend.h"
+
+#include <condition_variable>  // For workers waiting on the window.
+#include <cstddef>             // For std::size_t.
+#include <functional>          // For the row consumer.
+#include <mutex>               // For band bookkeeping.
+#include <utility>             // For std::move.
+#include <vector>              // For the band ring.
+
+/*
+ * Ordered band output for tiled rendering.
+ * The image is cut into bands of band_height rows, each covered by tiles_per_band tiles. Tiles finish in any order;
+ * rows go to the consumer strictly top to bottom as soon as every tile of their band is done. Only a window of bands
+ * is resident: a worker starting a band beyond it waits until the oldest band is flushed, so memory is bounded by
+ * window rows times image width whatever the image height. Tiles must be started in band order for that wait to end.
+ */
+class ordered_tile_sink {
+public:
+    // Receives row y (image_width pixels) once, in increasing y, under the sink's lock.
+    using row_consumer = std::function<void(int y, const color* row)>;
+
+private:
+    int width;
+    int height;
+    int band_height;
+    int band_count;
+    int tiles_per_band;
+    int window_bands;
+    std::vector<color> ring;     // window_bands bands of band_height rows
+    std::vector<int> remaining;  // Unfinished tiles of the band in each ring slot
+    int next_band = 0;           // Oldest band not yet flushed
+    row_consumer consume;
+
+    std::mutex lock;
+    std::condition_variable window_moved;
+
+    int slot(int band) const { return band % window_bands; }
+
+public:
+    ordered_tile_sink(int width, int height, int band_height, int tiles_per_band, int window_rows,
+                      row_consumer consume)
+        : width(width), height(height), band_height(band_height),
+          band_count((height + band_height - 1) / band_height), tiles_per_band(tiles_per_band),
+          window_bands(window_rows > band_height ? window_rows / band_height : 1), consume(std::move(consume)) {
+        ring.resize(static_cast<std::size_t>(window_bands) * band_height * width);
+        remaining.assign(window_bands, tiles_per_band);
+    }
+
+    ordered_tile_sink(const ordered_tile_sink&) = delete;
+    ordered_tile_sink& operator=(const ordered_tile_sink&) = delete;
+
+    // Blocks until `band` is inside the window; returns its first row, rows being `width` pixels apart.
+    color* begin_band(int band) {
+        std::unique_lock<std::mutex> guard(lock);
+        window_moved.wait(guard, [&] { return band < next_band + window_bands; });
+        return &ring[static_cast<std::size_t>(slot(band)) * band_height * width];
+    }
+
+    // Marks one tile of `band` finished and flushes every complete band that is next in order.
+    void finish_tile(int band) {
+        std::lock_guard<std::mutex> guard(lock);
+        remaining[slot(band)]--;
+
+        bool moved = false;
+        while (next_band < band_count && remaining[slot(next_band)] == 0) {
+            const color* rows = &ring[static_cast<std::size_t>(slot(next_band)) * band_height * width];
+            const int y0 = next_band * band_height;
+            const int y1 = y0 + band_height < height ? y0 + band_height : height;
+            for (int y = y0; y < y1; y++) consume(y, rows + static_cast<std::size_t>(y - y0) * width);
+
+            remaining[slot(next_band)] = tiles_per_band;
+            next_band++;
+            moved = true;
+        }
+        if (moved) window_moved.notify_all();
+    }
+
+    std::size_t resident_bytes() const { return ring.size() * sizeof(color); }
+};
+
+#endif
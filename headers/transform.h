@@ -0,0 +1,104 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+
+#include <cmath>  // For std::sin/cos in rotations.
+
+/*
+ * Affine transform: a 3x3 linear part plus a translation.
+ * Enough for instancing (rotation, scale, shear, translation) without the cost of full 4x4 matrices.
+ */
+struct affine_transform {
+    double m[3][3];
+    vec3 offset;
+
+    static affine_transform identity() {
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++) t.m[i][j] = i == j ? 1 : 0;
+        t.offset = vec3(0, 0, 0);
+        return t;
+    }
+
+    static affine_transform translation(const vec3& v) {
+        affine_transform t = identity();
+        t.offset = v;
+        return t;
+    }
+
+    static affine_transform scaling(double s) {
+        affine_transform t = identity();
+        t.m[0][0] = t.m[1][1] = t.m[2][2] = s;
+        return t;
+    }
+
+    static affine_transform rotation_y(double degrees) {
+        const double radians = degrees_to_radians(degrees);
+        const double c = std::cos(radians), s = std::sin(radians);
+        affine_transform t = identity();
+        t.m[0][0] = c;
+        t.m[0][2] = s;
+        t.m[2][0] = -s;
+        t.m[2][2] = c;
+        return t;
+    }
+
+    vec3 apply_vector(const vec3& v) const {
+        return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                    m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                    m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+    }
+
+    point3 apply_point(const point3& p) const { return apply_vector(p) + offset; }
+
+    // Multiplies by the transposed linear part; applied with the inverse transform, this maps normals.
+    vec3 apply_transposed(const vec3& v) const {
+        return vec3(m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+                    m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+                    m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z());
+    }
+
+    // Composition: (a * b) applies b first, then a.
+    friend affine_transform operator*(const affine_transform& a, const affine_transform& b) {
+        affine_transform t;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++) t.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+        t.offset = a.apply_point(b.offset);
+        return t;
+    }
+
+    // Inverse through the adjugate; the linear part must be invertible.
+    affine_transform inverse() const {
+        affine_transform t;
+        t.m[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        t.m[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+        t.m[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+        t.m[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        t.m[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+        t.m[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+        t.m[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        t.m[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+        t.m[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+        const double inv_det = 1.0 / (m[0][0] * t.m[0][0] + m[0][1] * t.m[1][0] + m[0][2] * t.m[2][0]);
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++) t.m[i][j] *= inv_det;
+        t.offset = -t.apply_vector(offset);
+        return t;
+    }
+
+    // Bounds of a transformed box, from its eight transformed corners.
+    aabb apply_box(const aabb& box) const {
+        aabb result = aabb::empty;
+        for (int corner = 0; corner < 8; corner++) {
+            point3 p(corner & 1 ? box.x.max : box.x.min, corner & 2 ? box.y.max : box.y.min,
+                     corner & 4 ? box.z.max : box.z.min);
+            point3 q = apply_point(p);
+            result = aabb(result, aabb(q, q));
+        }
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef UNIFORM_GRID_H
+#define UNIFORM_GRID_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "bvh.h"
+#include "compiled_scene.h"
+#include "sphere_accelerator.h"
+
+#include <algorithm>  // For std::clamp/min/max and the median radius.
+#include <cmath>      // For std::cbrt/floor.
+#include <cstdint>    // For cell offsets and sphere slots.
+#include <vector>     // For the cell arrays.
+
+/*
+ * Uniform grid over a compiled scene, traversed with 3D-DDA (Amanatides & Woo).
+ * Resolution is chosen automatically so the grid holds about `density` cells per sphere with roughly cubic cells.
+ * Spheres much larger than the typical one (radius above oversize_factor times the median, such as the cover scene's
+ * ground) would land in most cells, so they are kept out of the grid and tested for every ray before the walk; a hit on
+ * one also shortens the walk. Cells are stored CSR-style: cell_start[c]..cell_start[c + 1] indexes cell_items.
+ * Build is two linear passes with no sorting, well below BVH build time.
+ */
+class uniform_grid : public sphere_accelerator {
+private:
+    aabb grid_bounds;
+    int res[3] = {0, 0, 0};
+    double cell_size[3] = {0, 0, 0};
+    double inv_cell_size[3] = {0, 0, 0};
+    std::size_t grid_count = 0;  // Slots [0, grid_count) are gridded, the rest are oversized
+    std::vector<std::uint32_t> cell_start;
+    std::vector<std::uint32_t> cell_items;
+
+    static constexpr double oversize_factor = 16;
+    static constexpr int max_resolution = 512;  // Per axis
+
+    std::size_t cell_index(int x, int y, int z) const {
+        return (static_cast<std::size_t>(z) * res[1] + y) * res[0] + x;
+    }
+
+    int clamp_cell(int axis, double p) const {
+        int c = static_cast<int>(std::floor((p - grid_bounds.axis_interval(axis).min) * inv_cell_size[axis]));
+        return std::clamp(c, 0, res[axis] - 1);
+    }
+
+    // Inclusive cell range overlapped by slot i, padded by a sliver so boundary rounding never drops a cell.
+    void cell_range(std::size_t i, int lo[3], int hi[3]) const {
+        const aabb box = sphere_data.bounds(i);
+        for (int axis = 0; axis < 3; axis++) {
+            const double pad = cell_size[axis] * 1e-6;
+            lo[axis] = clamp_cell(axis, box.axis_interval(axis).min - pad);
+            hi[axis] = clamp_cell(axis, box.axis_interval(axis).max + pad);
+        }
+    }
+
+    template <typename F>
+    void for_each_cell(std::size_t i, F&& f) const {
+        int lo[3] = {}, hi[3] = {};
+        cell_range(i, lo, hi);
+        for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+                for (int x = lo[0]; x <= hi[0]; x++) f(cell_index(x, y, z));
+    }
+
+    void choose_resolution(double density) {
+        double extent[3];
+        double volume = 1;
+        for (int axis = 0; axis < 3; axis++) {
+            extent[axis] = std::max(grid_bounds.axis_interval(axis).size(), 1e-9);
+            volume *= extent[axis];
+        }
+        const double side = std::cbrt(volume / (density * static_cast<double>(grid_count)));
+        for (int axis = 0; axis < 3; axis++) {
+            res[axis] = std::clamp(static_cast<int>(extent[axis] / side + 0.5), 1, max_resolution);
+            cell_size[axis] = extent[axis] / res[axis];
+            inv_cell_size[axis] = 1.0 / cell_size[axis];
+        }
+    }
+
+    void build(double density) {
+        choose_resolution(density);
+        const std::size_t cells = static_cast<std::size_t>(res[0]) * res[1] * res[2];
+
+        // Pass 1 counts references per cell, pass 2 scatters slots after an exclusive prefix sum.
+        cell_start.assign(cells + 1, 0);
+        for (std::size_t i = 0; i < grid_count; i++) for_each_cell(i, [&](std::size_t c) { cell_start[c + 1]++; });
+        for (std::size_t c = 0; c < cells; c++) cell_start[c + 1] += cell_start[c];
+
+        cell_items.resize(cell_start[cells]);
+        std::vector<std::uint32_t> fill(cell_start.begin(), cell_start.end() - 1);
+        for (std::size_t i = 0; i < grid_count; i++) {
+            for_each_cell(i, [&](std::size_t c) { cell_items[fill[c]++] = static_cast<std::uint32_t>(i); });
+        }
+    }
+
+    template <bool CollectStats, bool AnyHit = false>
+    std::size_t traverse(const ray& r, interval ray_t, double& closest_so_far, bvh_traversal_stats* stats) const {
+        const point3& origin = r.origin();
+        const vec3 dir = r.direction();
+        const double a = dir.length_squared();
+
+        std::size_t closest = sphere_data.size();
+        if (sphere_data.size() == 0) return closest;
+        if constexpr (CollectStats) stats->rays++;
+
+        for (std::size_t i = grid_count; i < sphere_data.size(); i++) {
+            double t;
+            if (sphere_data.intersect(i, origin, dir, a, interval(ray_t.min, closest_so_far), t)) {
+                closest_so_far = t;
+                closest = i;
+                if constexpr (AnyHit) return closest;
+            }
+        }
+        if constexpr (CollectStats) stats->primitive_tests += sphere_data.size() - grid_count;
+        if (grid_count == 0) return closest;
+
+        // Clip the ray to the grid. A NaN slab distance (zero direction on a boundary plane) leaves the bounds as they are.
+        const double o[3] = {origin.x(), origin.y(), origin.z()};
+        const double d[3] = {dir.x(), dir.y(), dir.z()};
+        double t_enter = ray_t.min, t_exit = closest_so_far;
+        for (int axis = 0; axis < 3; axis++) {
+            const double inv = 1.0 / d[axis];
+            double t0 = (grid_bounds.axis_interval(axis).min - o[axis]) * inv;
+            double t1 = (grid_bounds.axis_interval(axis).max - o[axis]) * inv;
+            if (t0 > t1) std::swap(t0, t1);
+            t_enter = std::max(t_enter, t0);
+            t_exit = std::min(t_exit, t1);
+        }
+        if (t_enter > t_exit) return closest;
+
+        int cell[3], step[3];
+        double t_next[3], t_delta[3];
+        for (int axis = 0; axis < 3; axis++) {
+            cell[axis] = clamp_cell(axis, o[axis] + t_enter * d[axis]);
+            if (d[axis] > 0) {
+                step[axis] = 1;
+                double boundary = grid_bounds.axis_interval(axis).min + (cell[axis] + 1) * cell_size[axis];
+                t_next[axis] = (boundary - o[axis]) / d[axis];
+                t_delta[axis] = cell_size[axis] / d[axis];
+            } else if (d[axis] < 0) {
+                step[axis] = -1;
+                double boundary = grid_bounds.axis_interval(axis).min + cell[axis] * cell_size[axis];
+                t_next[axis] = (boundary - o[axis]) / d[axis];
+                t_delta[axis] = -cell_size[axis] / d[axis];
+            } else {
+                step[axis] = 0;
+                t_next[axis] = infinity;
+                t_delta[axis] = infinity;
+            }
+        }
+
+        while (true) {
+            const std::size_t c = cell_index(cell[0], cell[1], cell[2]);
+            if constexpr (CollectStats) {
+                stats->nodes_visited++;
+                stats->primitive_tests += cell_start[c + 1] - cell_start[c];
+            }
+            for (std::uint32_t k = cell_start[c]; k < cell_start[c + 1]; k++) {
+                const std::uint32_t i = cell_items[k];
+                double t;
+                if (sphere_data.intersect(i, origin, dir, a, interval(ray_t.min, closest_so_far), t)) {
+                    closest_so_far = t;
+                    closest = i;
+                    if constexpr (AnyHit) return closest;
+                }
+            }
+
+            // Step across the nearest cell boundary. Any sphere not seen yet is first entered beyond it, so a hit
+            // closer than the boundary is final.
+            const int axis = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+            if (closest_so_far <= t_next[axis] || t_next[axis] > t_exit) break;
+            cell[axis] += step[axis];
+            if (cell[axis] < 0 || cell[axis] >= res[axis]) break;
+            t_next[axis] += t_delta[axis];
+        }
+        return closest;
+    }
+
+public:
+    explicit uniform_grid(const compiled_scene& scene, double density = 3) : sphere_accelerator(scene) {
+        const sphere_soa& source = scene.spheres();
+        if (source.size() == 0) return;
+
+        std::vector<double> radii(source.radius.begin(), source.radius.end());
+        std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+        const double oversized = radii[radii.size() / 2] * oversize_factor;
+
+        // Gridded spheres first, then the oversized ones, each keeping its original primitive id.
+        sphere_data.reserve(source.size());
+        prim_ids.reserve(source.size());
+        grid_bounds = aabb::empty;
+        for (int pass = 0; pass < 2; pass++) {
+            for (std::size_t i = 0; i < source.size(); i++) {
+                if ((source.radius[i] > oversized) != (pass == 1)) continue;
+                sphere_data.push_back_from(source, i);
+                prim_ids.push_back(static_cast<std::uint32_t>(i));
+                if (pass == 0) grid_bounds = aabb(grid_bounds, source.bounds(i));
+            }
+            if (pass == 0) grid_count = sphere_data.size();
+        }
+
+        if (grid_count > 0) build(density);
+    }
+
+    int resolution(int axis) const { return res[axis]; }
+    std::size_t oversized_count() const { return sphere_data.size() - grid_count; }
+
+    // Cells and bytes of the cell arrays; named like the BVH accessors so the benchmarks treat every structure alike.
+    std::size_t node_count() const { return cell_start.empty() ? 0 : cell_start.size() - 1; }
+    std::size_t node_bytes() const {
+        return (cell_start.size() + cell_items.size()) * sizeof(std::uint32_t);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return hit_with_stats(r, ray_t, rec, nullptr);
+    }
+
+    // Closest hit, optionally accumulating traversal counts; nodes_visited counts grid cells.
+    bool hit_with_stats(const ray& r, interval ray_t, hit_record& rec, bvh_traversal_stats* stats) const {
+        double closest_so_far = ray_t.max;
+        std::size_t closest = stats ? traverse<true>(r, ray_t, closest_so_far, stats)
+                                    : traverse<false>(r, ray_t, closest_so_far, nullptr);
+        return finish_hit(r, ray_t, closest, closest_so_far, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        double closest_so_far = ray_t.max;
+        return traverse<false, true>(r, ray_t, closest_so_far, nullptr) < sphere_data.size() ||
+               others_occluded(other_objects, r, ray_t);
+    }
+};
+
+#endif
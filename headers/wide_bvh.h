@@ -0,0 +1,361 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "rtweekend.h"
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "bvh_build.h"
+#include "compiled_scene.h"
+#include "sphere_accelerator.h"
+
+#include <algorithm>  // For std::max/min in the scalar child test.
+#include <cmath>      // For std::signbit.
+#include <cstdint>    // For child indices and counts.
+#include <limits>     // For float infinity in empty slots.
+#include <vector>     // For subtree ranges.
+
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Wide BVH node.
+ * N children (4 or 8) with their bounds stored as SoA float lanes, so one SIMD comparison sequence tests a ray against
+ * every child at once. Leaf children reference a small contiguous batch of spheres in the SoA sphere arrays.
+ * Empty slots hold an inverted (+inf, -inf) box that fails every test.
+ */
+template <int N>
+struct alignas(64) wide_bvh_node {
+    float min_x[N], min_y[N], min_z[N];
+    float max_x[N], max_y[N], max_z[N];
+    std::uint32_t child[N];  // Interior: node index; leaf: first sphere slot
+    std::uint8_t count[N];   // Leaf: sphere count; 0 for interior and empty slots
+
+    void clear() {
+        for (int i = 0; i < N; i++) {
+            min_x[i] = min_y[i] = min_z[i] = std::numeric_limits<float>::infinity();
+            max_x[i] = max_y[i] = max_z[i] = -std::numeric_limits<float>::infinity();
+            child[i] = 0;
+            count[i] = 0;
+        }
+    }
+
+    void set_bounds(int slot, const aabb& box) {
+        min_x[slot] = round_down_float(box.x.min);
+        min_y[slot] = round_down_float(box.y.min);
+        min_z[slot] = round_down_float(box.z.min);
+        max_x[slot] = round_up_float(box.x.max);
+        max_y[slot] = round_up_float(box.y.max);
+        max_z[slot] = round_up_float(box.z.max);
+    }
+};
+
+/*
+ * Per-ray data for float slab tests.
+ * The double ray origin is rounded both ways and each plane uses the side that can only widen the slab, and the far
+ * distance is scaled by (1 + 2*gamma(3)) as in pbrt, so float arithmetic never rejects a box the exact ray enters.
+ */
+struct wide_ray {
+    float origin_near[3], origin_far[3], inv_dir[3];
+    bool negative[3];
+
+    explicit wide_ray(const ray& r) {
+        const point3& o = r.origin();
+        const vec3 d = r.direction();
+        const double oc[3] = {o.x(), o.y(), o.z()};
+        const double dc[3] = {d.x(), d.y(), d.z()};
+        for (int axis = 0; axis < 3; axis++) {
+            negative[axis] = std::signbit(dc[axis]);  // -0.0 counts as negative, matching 1/-0.0 = -inf
+            inv_dir[axis] = static_cast<float>(1.0 / dc[axis]);
+            origin_near[axis] = negative[axis] ? round_down_float(oc[axis]) : round_up_float(oc[axis]);
+            origin_far[axis] = negative[axis] ? round_up_float(oc[axis]) : round_down_float(oc[axis]);
+        }
+    }
+
+    static constexpr float far_scale = 1.0000005f;
+};
+
+/*
+ * Tests a ray against all N children of a node; returns a bit mask of hit children and writes their entry distances.
+ * Uses one SSE (N = 4) or AVX (N = 8) lane per child where available, and a plain loop the compiler can vectorize
+ * otherwise.
+ */
+template <int N>
+inline int intersect_children(const wide_bvh_node<N>& node, const wide_ray& r, float t_min, float t_max,
+                              float t_near_out[N]) {
+    const float* near_x = r.negative[0] ? node.max_x : node.min_x;
+    const float* near_y = r.negative[1] ? node.max_y : node.min_y;
+    const float* near_z = r.negative[2] ? node.max_z : node.min_z;
+    const float* far_x = r.negative[0] ? node.min_x : node.max_x;
+    const float* far_y = r.negative[1] ? node.min_y : node.max_y;
+    const float* far_z = r.negative[2] ? node.min_z : node.max_z;
+
+#if defined(__SSE__)
+    if constexpr (N == 4) {
+        auto slab = [](const float* plane, float o, float inv) {
+            return _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(plane), _mm_set1_ps(o)), _mm_set1_ps(inv));
+        };
+        __m128 tnx = slab(near_x, r.origin_near[0], r.inv_dir[0]);
+        __m128 tny = slab(near_y, r.origin_near[1], r.inv_dir[1]);
+        __m128 tnz = slab(near_z, r.origin_near[2], r.inv_dir[2]);
+        __m128 tfx = slab(far_x, r.origin_far[0], r.inv_dir[0]);
+        __m128 tfy = slab(far_y, r.origin_far[1], r.inv_dir[1]);
+        __m128 tfz = slab(far_z, r.origin_far[2], r.inv_dir[2]);
+        __m128 t_near = _mm_max_ps(_mm_max_ps(tnx, tny), _mm_max_ps(tnz, _mm_set1_ps(t_min)));
+        __m128 t_far = _mm_min_ps(_mm_min_ps(tfx, tfy), _mm_min_ps(tfz, _mm_set1_ps(t_max)));
+        _mm_storeu_ps(t_near_out, t_near);
+        return _mm_movemask_ps(_mm_cmple_ps(t_near, _mm_mul_ps(t_far, _mm_set1_ps(wide_ray::far_scale))));
+    }
+#endif
+#if defined(__AVX__)
+    if constexpr (N == 8) {
+        auto slab = [](const float* plane, float o, float inv) {
+            return _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(plane), _mm256_set1_ps(o)), _mm256_set1_ps(inv));
+        };
+        __m256 tnx = slab(near_x, r.origin_near[0], r.inv_dir[0]);
+        __m256 tny = slab(near_y, r.origin_near[1], r.inv_dir[1]);
+        __m256 tnz = slab(near_z, r.origin_near[2], r.inv_dir[2]);
+        __m256 tfx = slab(far_x, r.origin_far[0], r.inv_dir[0]);
+        __m256 tfy = slab(far_y, r.origin_far[1], r.inv_dir[1]);
+        __m256 tfz = slab(far_z, r.origin_far[2], r.inv_dir[2]);
+        __m256 t_near = _mm256_max_ps(_mm256_max_ps(tnx, tny), _mm256_max_ps(tnz, _mm256_set1_ps(t_min)));
+        __m256 t_far = _mm256_min_ps(_mm256_min_ps(tfx, tfy), _mm256_min_ps(tfz, _mm256_set1_ps(t_max)));
+        _mm256_storeu_ps(t_near_out, t_near);
+        __m256 scaled_far = _mm256_mul_ps(t_far, _mm256_set1_ps(wide_ray::far_scale));
+        return _mm256_movemask_ps(_mm256_cmp_ps(t_near, scaled_far, _CMP_LE_OQ));
+    }
+#endif
+
+    int mask = 0;
+    for (int i = 0; i < N; i++) {
+        float tnx = (near_x[i] - r.origin_near[0]) * r.inv_dir[0];
+        float tny = (near_y[i] - r.origin_near[1]) * r.inv_dir[1];
+        float tnz = (near_z[i] - r.origin_near[2]) * r.inv_dir[2];
+        float tfx = (far_x[i] - r.origin_far[0]) * r.inv_dir[0];
+        float tfy = (far_y[i] - r.origin_far[1]) * r.inv_dir[1];
+        float tfz = (far_z[i] - r.origin_far[2]) * r.inv_dir[2];
+        float t_near = std::max(std::max(tnx, tny), std::max(tnz, t_min));
+        float t_far = std::min(std::min(tfx, tfy), std::min(tfz, t_max));
+        t_near_out[i] = t_near;
+        mask |= (t_near <= t_far * wide_ray::far_scale) << i;
+    }
+    return mask;
+}
+
+/*
+ * Wide collapse helpers, shared by every wide layout.
+ * A subtree range is the contiguous slice of leaf-ordered spheres under a build node; subtrees with at most
+ * wide_leaf_batch spheres become one leaf batch. That matches the SAH builder's leaf size, since larger batches trade
+ * too many extra sphere tests for fewer node visits.
+ */
+constexpr std::uint32_t wide_leaf_batch = 4;
+
+struct subtree_range {
+    std::uint32_t first, count;
+};
+
+inline subtree_range compute_subtree_ranges(const bvh_build_tree& tree, std::uint32_t index,
+                                            std::vector<subtree_range>& ranges) {
+    const bvh_build_node& node = tree.nodes[index];
+    if (node.is_leaf()) {
+        ranges[index] = {node.first, node.count};
+    } else {
+        subtree_range left = compute_subtree_ranges(tree, node.left, ranges);
+        subtree_range right = compute_subtree_ranges(tree, node.right, ranges);
+        ranges[index] = {std::min(left.first, right.first), left.count + right.count};
+    }
+    return ranges[index];
+}
+
+inline bool is_leaf_batch(const bvh_build_tree& tree, const std::vector<subtree_range>& ranges, std::uint32_t i) {
+    return tree.nodes[i].is_leaf() || ranges[i].count <= wide_leaf_batch;
+}
+
+// Picks up to N children for a wide node by repeatedly opening the largest child that is not a leaf batch.
+template <int N>
+int gather_wide_children(const bvh_build_tree& tree, const std::vector<subtree_range>& ranges, std::uint32_t index,
+                         std::uint32_t kids[N]) {
+    int kid_count = 0;
+    if (is_leaf_batch(tree, ranges, index)) {
+        kids[kid_count++] = index;
+        return kid_count;
+    }
+    kids[kid_count++] = tree.nodes[index].left;
+    kids[kid_count++] = tree.nodes[index].right;
+
+    while (kid_count < N) {
+        int best = -1;
+        double best_area = -1;
+        for (int k = 0; k < kid_count; k++) {
+            if (is_leaf_batch(tree, ranges, kids[k])) continue;
+            double area = tree.nodes[kids[k]].bbox.surface_area();
+            if (area > best_area) {
+                best_area = area;
+                best = k;
+            }
+        }
+        if (best < 0) break;
+        const bvh_build_node& opened = tree.nodes[kids[best]];
+        kids[best] = opened.left;
+        kids[kid_count++] = opened.right;
+    }
+    return kid_count;
+}
+
+/*
+ * Closest-hit traversal of a wide node array over SoA spheres; returns the closest sphere slot, or spheres.size() on a
+ * miss. Works on raw arrays so owned trees and memory-mapped caches share it. Hit children are visited nearest-first,
+ * and stacked subtrees whose entry distance is already beyond the closest hit are skipped. With AnyHit set, the first
+ * sphere found inside the interval is returned instead.
+ */
+template <int N, bool CollectStats, bool AnyHit = false>
+std::size_t traverse_wide(const wide_bvh_node<N>* nodes, std::size_t node_count, const sphere_view& spheres,
+                          const ray& r, interval ray_t, double& closest_so_far, bvh_traversal_stats* stats) {
+    const point3& origin = r.origin();
+    const vec3 dir = r.direction();
+    const double a = dir.length_squared();
+    const wide_ray wr(r);
+    const float t_min = round_down_float(ray_t.min);
+
+    std::size_t closest = spheres.size();
+    if (node_count == 0) return closest;
+    if constexpr (CollectStats) stats->rays++;
+
+    struct entry {
+        std::uint32_t node;
+        float t_near;
+    };
+    entry stack[128 * N];
+    int top = 0;
+    stack[top++] = {0, -std::numeric_limits<float>::infinity()};
+
+    while (top > 0) {
+        const entry e = stack[--top];
+        if (e.t_near > closest_so_far) continue;
+
+        const wide_bvh_node<N>& node = nodes[e.node];
+        if constexpr (CollectStats) stats->nodes_visited++;
+
+        float t_near[N];
+        int mask = intersect_children(node, wr, t_min, round_up_float(closest_so_far), t_near);
+        if (mask == 0) continue;
+
+        // Order the hit children nearest-first (insertion sort over at most N entries).
+        int order[N];
+        int hits = 0;
+        for (int i = 0; i < N; i++) {
+            if (!(mask & (1 << i))) continue;
+            int j = hits++;
+            while (j > 0 && t_near[order[j - 1]] > t_near[i]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+        }
+
+        // Leaf batches are tested in order right away; interior children are pushed farthest-first.
+        for (int h = 0; h < hits; h++) {
+            const int slot = order[h];
+            if (node.count[slot] == 0 || t_near[slot] > closest_so_far) continue;
+            if constexpr (CollectStats) {
+                stats->leaves_visited++;
+                stats->primitive_tests += node.count[slot];
+            }
+            for (std::uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; i++) {
+                double t;
+                if (spheres.intersect(i, origin, dir, a, interval(ray_t.min, closest_so_far), t)) {
+                    closest_so_far = t;
+                    closest = i;
+                    if constexpr (AnyHit) return closest;
+                }
+            }
+        }
+        for (int h = hits - 1; h >= 0; h--) {
+            const int slot = order[h];
+            if (node.count[slot] == 0) stack[top++] = {node.child[slot], t_near[slot]};
+        }
+    }
+    return closest;
+}
+
+/*
+ * Wide bounding volume hierarchy (QBVH for N = 4, OBVH for N = 8).
+ * Built with the binary builders, then collapsed: each wide node repeatedly opens its largest interior child until it
+ * has N children, and any subtree holding at most wide_leaf_batch spheres becomes a single leaf batch. Traversal tests all
+ * children of a node at once, visits the hit ones nearest-first and skips stacked subtrees whose entry distance is
+ * already beyond the closest hit.
+ */
+template <int N>
+class wide_bvh : public sphere_accelerator {
+    static_assert(N == 4 || N == 8, "wide_bvh supports 4- and 8-wide nodes");
+
+private:
+    aligned_vector<wide_bvh_node<N>> nodes;
+
+    std::uint32_t collapse(const bvh_build_tree& tree, const std::vector<subtree_range>& ranges, std::uint32_t index) {
+        const std::uint32_t out = static_cast<std::uint32_t>(nodes.size());
+        nodes.emplace_back();
+        nodes[out].clear();
+
+        std::uint32_t kids[N];
+        const int kid_count = gather_wide_children<N>(tree, ranges, index, kids);
+
+        for (int k = 0; k < kid_count; k++) {
+            nodes[out].set_bounds(k, tree.nodes[kids[k]].bbox);
+            if (is_leaf_batch(tree, ranges, kids[k])) {
+                nodes[out].child[k] = ranges[kids[k]].first;
+                nodes[out].count[k] = static_cast<std::uint8_t>(ranges[kids[k]].count);
+            } else {
+                std::uint32_t child = collapse(tree, ranges, kids[k]);
+                nodes[out].child[k] = child;
+            }
+        }
+        return out;
+    }
+
+    template <bool CollectStats, bool AnyHit = false>
+    std::size_t traverse(const ray& r, interval ray_t, double& closest_so_far, bvh_traversal_stats* stats) const {
+        return traverse_wide<N, CollectStats, AnyHit>(nodes.data(), nodes.size(), sphere_data.view(), r, ray_t,
+                                                      closest_so_far, stats);
+    }
+
+public:
+    explicit wide_bvh(const compiled_scene& scene, bvh_builder builder = bvh_builder::binned_sah, unsigned threads = 0,
+                      int sah_bins = 32)
+        : sphere_accelerator(scene) {
+        bvh_build_tree tree = build_tree(scene, builder, threads, sah_bins);
+        if (tree.nodes.empty()) return;
+
+        std::vector<subtree_range> ranges(tree.nodes.size());
+        compute_subtree_ranges(tree, tree.root, ranges);
+        nodes.reserve(tree.nodes.size() / (N - 1) + 1);
+        collapse(tree, ranges, tree.root);
+    }
+
+    std::size_t node_count() const { return nodes.size(); }
+    std::size_t node_bytes() const { return nodes.size() * sizeof(wide_bvh_node<N>); }
+    const aligned_vector<wide_bvh_node<N>>& node_array() const { return nodes; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return hit_with_stats(r, ray_t, rec, nullptr);
+    }
+
+    // Closest hit, optionally accumulating traversal counts; nodes_visited counts wide nodes (N box tests each).
+    bool hit_with_stats(const ray& r, interval ray_t, hit_record& rec, bvh_traversal_stats* stats) const {
+        double closest_so_far = ray_t.max;
+        std::size_t closest = stats ? traverse<true>(r, ray_t, closest_so_far, stats)
+                                    : traverse<false>(r, ray_t, closest_so_far, nullptr);
+        return finish_hit(r, ray_t, closest, closest_so_far, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        double closest_so_far = ray_t.max;
+        return traverse<false, true>(r, ray_t, closest_so_far, nullptr) < sphere_data.size() ||
+               others_occluded(other_objects, r, ray_t);
+    }
+};
+
+using qbvh = wide_bvh<4>;
+using obvh = wide_bvh<8>;
+
+#endif
@@ -0,0 +1,954 @@
+/*
+ * micro benchmarks for the scene and acceleration code
+ */
+
+#include "rtweekend.h"
+
+#include "accumulation_buffer.h"
+#include "arena.h"
+#include "async_writer.h"
+#include "bvh.h"
+#include "bvh_cache.h"
+#include "compiled_scene.h"
+#include "compressed_bvh.h"
+#include "dynamic_bvh.h"
+#include "framebuffer.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "image_writer.h"
+#include "live_framebuffer.h"
+#include "material_registry.h"
+#include "pixel_formats.h"
+#include "quantize.h"
+#include "ray_batch.h"
+#include "scenes.h"
+#include "sphere.h"
+#include "transform.h"
+#include "uniform_grid.h"
+#include "wide_bvh.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+/*
+ * Hardware cache-miss counter.
+ * Wraps perf_event_open for the calling thread; reports -1 where the kernel or sandbox does not expose the PMU.
+ */
+class cache_miss_counter {
+private:
+    int fd = -1;
+
+public:
+    cache_miss_counter() {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~cache_miss_counter() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    long long stop() {
+#ifdef __linux__
+        if (fd < 0) return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+        return count;
+#else
+        return -1;
+#endif
+    }
+};
+
+// Fixed set of rays aimed from around the cover-scene camera into the sphere field.
+static std::vector<ray> make_rays(int count) {
+    std::srand(7);
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (int i = 0; i < count; i++) {
+        point3 origin(13 + random_double(-1, 1), 2 + random_double(-1, 1), 3 + random_double(-1, 1));
+        point3 target(random_double(-11, 11), random_double(0, 1), random_double(-11, 11));
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+// The cover scene at half_extent, compiled, with make_rays(ray_count) aimed into it: the fixture most benchmarks share.
+struct sphere_field {
+    scene_arena arena;
+    hittable_list world;
+    compiled_scene scene;
+    std::vector<ray> rays;
+
+    sphere_field(int half_extent, int ray_count)
+        : scene(populate(world, arena, half_extent)), rays(make_rays(ray_count)) {}
+
+private:
+    static const hittable_list& populate(hittable_list& world, scene_arena& arena, int half_extent) {
+        std::srand(1);
+        random_spheres_scene(world, arena, half_extent);
+        return world;
+    }
+};
+
+// Closest-hit throughput over a ray set; returns the hit count so the loop cannot be optimized away.
+static int trace_rays(const hittable& world, const std::vector<ray>& rays, double& seconds) {
+    int hits = 0;
+    hit_record rec;
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+        if (world.hit(r, interval(0.001, infinity), rec)) {
+            hits++;
+        }
+    }
+    seconds = seconds_since(start);
+    return hits;
+}
+
+static void bench_scene_construction(int half_extent, int ray_count) {
+    std::printf("scene construction, half_extent %d\n", half_extent);
+
+    double heap_build, arena_build, heap_trace, arena_trace;
+    int heap_hits, arena_hits;
+    auto rays = make_rays(ray_count);
+
+    {
+        std::srand(1);
+        heap_factory heap;
+        hittable_list world;
+        auto start = bench_clock::now();
+        random_spheres_scene(world, heap, half_extent);
+        heap_build = seconds_since(start);
+        heap_hits = trace_rays(world, rays, heap_trace);
+        std::printf("  objects                %zu\n", world.objects.size());
+    }
+    {
+        std::srand(1);
+        scene_arena arena;
+        hittable_list world;
+        auto start = bench_clock::now();
+        random_spheres_scene(world, arena, half_extent);
+        arena_build = seconds_since(start);
+        arena_hits = trace_rays(world, rays, arena_trace);
+        std::printf("  arena bytes / blocks   %zu / %zu\n", arena.bytes_used(), arena.block_count());
+    }
+
+    std::printf("  build   make_shared %9.3f ms   arena %9.3f ms\n", 1e3 * heap_build, 1e3 * arena_build);
+    std::printf("  trace   make_shared %9.3f ms   arena %9.3f ms   (%d rays, hits %d / %d)\n",
+                1e3 * heap_trace, 1e3 * arena_trace, ray_count, heap_hits, arena_hits);
+}
+
+// Traces the same rays through the object graph and the compiled SoA scene, with cache misses where available.
+static void bench_compiled_scene(int half_extent, int ray_count) {
+    std::printf("compiled scene, half_extent %d\n", half_extent);
+
+    std::srand(1);
+    heap_factory heap;
+    hittable_list world;
+    random_spheres_scene(world, heap, half_extent);
+    compiled_scene scene(world);
+    auto rays = make_rays(ray_count);
+
+    cache_miss_counter misses;
+    double list_seconds, compiled_seconds;
+
+    misses.start();
+    int list_hits = trace_rays(world, rays, list_seconds);
+    long long list_misses = misses.stop();
+
+    misses.start();
+    int compiled_hits = trace_rays(scene, rays, compiled_seconds);
+    long long compiled_misses = misses.stop();
+
+    std::printf("  spheres / materials    %zu / %zu\n", scene.spheres().size(), scene.materials().size());
+    std::printf("  hittable_list  %9.3f ms  cache misses %lld\n", 1e3 * list_seconds, list_misses);
+    std::printf("  compiled_scene %9.3f ms  cache misses %lld\n", 1e3 * compiled_seconds, compiled_misses);
+    std::printf("  hits %d / %d  (cache misses -1: counter unavailable)\n", list_hits, compiled_hits);
+}
+
+// Material interning on a procedural scene: requested versus unique materials and the bytes that were not allocated.
+static void bench_material_interning(int half_extent) {
+    std::printf("material interning, half_extent %d\n", half_extent);
+
+    std::srand(1);
+    scene_arena arena;
+    material_registry<scene_arena> registry(arena);
+    hittable_list world;
+    auto start = bench_clock::now();
+    random_spheres_scene(world, registry, half_extent);
+    double seconds = seconds_since(start);
+    compiled_scene scene(world);
+
+    std::printf("  materials requested / unique   %zu / %zu\n", registry.requests(), registry.unique());
+    std::printf("  compiled material table        %zu\n", scene.materials().size());
+    std::printf("  bytes saved                    %zu\n", registry.bytes_saved());
+    std::printf("  build                          %9.3f ms\n", 1e3 * seconds);
+}
+
+// BVH build time on one thread versus all threads, and the SAH cost and trace time of the result.
+static void bench_bvh_build(const char* name, bvh_builder builder, int half_extent, int ray_count, int bins = 32) {
+    std::printf("bvh %s (%d bins), half_extent %d\n", name, bins, half_extent);
+
+    sphere_field field(half_extent, ray_count);
+    const compiled_scene& scene = field.scene;
+    const std::vector<ray>& rays = field.rays;
+
+    auto start = bench_clock::now();
+    bvh serial(scene, builder, 1, bins);
+    double serial_seconds = seconds_since(start);
+
+    start = bench_clock::now();
+    bvh parallel(scene, builder, 0, bins);
+    double parallel_seconds = seconds_since(start);
+
+    double trace_seconds;
+    int hits = trace_rays(parallel, rays, trace_seconds);
+
+    std::printf("  primitives / nodes     %zu / %zu\n", scene.spheres().size(), parallel.node_count());
+    std::printf("  build 1 thread %9.3f ms   %u threads %9.3f ms\n",
+                1e3 * serial_seconds, worker_count(), 1e3 * parallel_seconds);
+    std::printf("  SAH cost               %.2f\n", parallel.sah_cost());
+    std::printf("  trace                  %9.3f ms   (%d rays, %d hits)\n", 1e3 * trace_seconds, ray_count, hits);
+
+    bvh_traversal_stats stats;
+    hit_record rec;
+    for (const auto& r : rays) parallel.hit_with_stats(r, interval(0.001, infinity), rec, &stats);
+    std::printf("  node bytes             %zu (%zu B/node)\n", parallel.node_bytes(), sizeof(bvh_node));
+    std::printf("  per ray: nodes %.1f  leaves %.1f  sphere tests %.1f\n",
+                stats.nodes_per_ray(), stats.leaves_per_ray(), stats.primitives_per_ray());
+}
+
+// Binary versus 4- and 8-wide BVH on the same SAH tree: rays per second, node memory and per-ray node visits.
+template <typename Accel>
+static void report_accel(const char* name, const Accel& accel, const std::vector<ray>& rays) {
+    double seconds;
+    int hits = trace_rays(accel, rays, seconds);
+
+    bvh_traversal_stats stats;
+    hit_record rec;
+    for (const auto& r : rays) accel.hit_with_stats(r, interval(0.001, infinity), rec, &stats);
+
+    std::printf("  %-6s %8.2f Mrays/s  nodes %8zu  %9zu B  per ray: nodes %5.1f  sphere tests %4.1f  (hits %d)\n",
+                name, rays.size() / seconds * 1e-6, accel.node_count(), accel.node_bytes(),
+                stats.nodes_per_ray(), stats.primitives_per_ray(), hits);
+}
+
+static void bench_wide_bvh(int half_extent, int ray_count) {
+    std::printf("wide bvh, half_extent %d\n", half_extent);
+
+    sphere_field field(half_extent, ray_count);
+    const compiled_scene& scene = field.scene;
+    const std::vector<ray>& rays = field.rays;
+
+    report_accel("bvh2", bvh(scene), rays);
+    report_accel("bvh4", qbvh(scene), rays);
+    report_accel("bvh8", obvh(scene), rays);
+}
+
+static void bench_compressed_bvh(int half_extent, int ray_count) {
+    sphere_field field(half_extent, ray_count);
+    const compiled_scene& scene = field.scene;
+    const std::vector<ray>& rays = field.rays;
+
+    std::printf("compressed wide bvh, half_extent %d, %zu spheres\n", half_extent, scene.spheres().size());
+
+    auto report = [&](const char* name, const auto& accel) {
+        report_accel(name, accel, rays);
+        std::printf("         %.1f node bytes per sphere\n", double(accel.node_bytes()) / accel.primitive_count());
+    };
+    report("bvh4", qbvh(scene));
+    report("cbvh4", compressed_qbvh(scene));
+    report("bvh8", obvh(scene));
+    report("cbvh8", compressed_obvh(scene));
+}
+
+static void bench_uniform_grid(int half_extent, int ray_count) {
+    sphere_field field(half_extent, ray_count);
+    const compiled_scene& scene = field.scene;
+    const std::vector<ray>& rays = field.rays;
+
+    std::printf("uniform grid, half_extent %d, %zu spheres\n", half_extent, scene.spheres().size());
+
+    auto start = bench_clock::now();
+    uniform_grid grid(scene);
+    double grid_build = seconds_since(start);
+    start = bench_clock::now();
+    qbvh wide(scene);
+    double bvh_build = seconds_since(start);
+
+    std::printf("  build: grid %.4f s (%d x %d x %d, %zu oversized), bvh4 %.4f s\n", grid_build, grid.resolution(0),
+                grid.resolution(1), grid.resolution(2), grid.oversized_count(), bvh_build);
+    report_accel("grid", grid, rays);
+    report_accel("bvh4", wide, rays);
+}
+
+/*
+ * A field of grid_side^2 copies of one sphere cluster: instanced over a shared BLAS versus flattened into one BVH.
+ * Clusters are rotated about y, uniformly scaled and translated, so the flattened copy is exact spheres too.
+ */
+static void bench_instancing(int cluster_size, int grid_side, int ray_count) {
+    std::srand(3);
+    scene_arena arena;
+    auto mat = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+
+    struct local_sphere {
+        point3 center;
+        double radius;
+    };
+    std::vector<local_sphere> cluster_spheres;
+    hittable_list cluster;
+    for (int i = 0; i < cluster_size; i++) {
+        local_sphere s{point3(random_double(-1, 1), random_double(-1, 1), random_double(-1, 1)), random_double(0.05, 0.15)};
+        cluster_spheres.push_back(s);
+        cluster.add(arena.make<sphere>(s.center, s.radius, mat));
+    }
+
+    std::vector<affine_transform> placements;
+    const double spacing = 22.0 / grid_side;
+    for (int gx = 0; gx < grid_side; gx++) {
+        for (int gz = 0; gz < grid_side; gz++) {
+            double scale = spacing * random_double(0.3, 0.5);
+            placements.push_back(affine_transform::translation(vec3(-11 + (gx + 0.5) * spacing, scale,
+                                                                    -11 + (gz + 0.5) * spacing)) *
+                                 affine_transform::rotation_y(random_double(0, 360)) *
+                                 affine_transform::scaling(scale));
+        }
+    }
+    auto rays = make_rays(ray_count);
+    const std::size_t sphere_bytes = 4 * sizeof(double) + 2 * sizeof(std::uint32_t);  // SoA fields plus primitive id
+
+    std::printf("instancing, %zu instances of %d spheres\n", placements.size(), cluster_size);
+
+    auto start = bench_clock::now();
+    compiled_scene cluster_scene(cluster);
+    auto blas = make_shared<qbvh>(cluster_scene);
+    std::vector<instance> instances;
+    instances.reserve(placements.size());
+    for (const auto& xf : placements) instances.emplace_back(blas, xf);
+    tlas top(std::move(instances));
+    double instanced_build = seconds_since(start);
+    std::size_t instanced_bytes = blas->node_bytes() + blas->primitive_count() * sphere_bytes +
+                                  top.instance_count() * sizeof(instance) + top.node_bytes();
+
+    double seconds;
+    int hits = trace_rays(top, rays, seconds);
+    std::printf("  instanced  build %.4f s  %10zu B  %6.2f Mrays/s  (hits %d)\n", instanced_build, instanced_bytes,
+                rays.size() / seconds * 1e-6, hits);
+
+    start = bench_clock::now();
+    for (std::size_t i = 0; i < top.instance_count(); i++) {
+        top.set_transform(i, affine_transform::translation(vec3(0, 0.01, 0)) * top.get_instance(i).transform());
+    }
+    top.rebuild();
+    std::printf("  move all instances + tlas rebuild %.4f s\n", seconds_since(start));
+
+    hittable_list flat;
+    for (const auto& xf : placements) {
+        double scale = xf.apply_vector(vec3(1, 0, 0)).length();
+        for (const auto& s : cluster_spheres) flat.add(arena.make<sphere>(xf.apply_point(s.center), s.radius * scale, mat));
+    }
+    start = bench_clock::now();
+    compiled_scene flat_scene(flat);
+    qbvh flat_bvh(flat_scene);
+    double flat_build = seconds_since(start);
+    std::size_t flat_bytes = flat_bvh.node_bytes() + flat_bvh.primitive_count() * sphere_bytes;
+
+    hits = trace_rays(flat_bvh, rays, seconds);
+    std::printf("  flattened  build %.4f s  %10zu B  %6.2f Mrays/s  (hits %d)\n", flat_build, flat_bytes,
+                rays.size() / seconds * 1e-6, hits);
+}
+
+/*
+ * Animation: a few spheres jitter every frame. Compares refit plus quality maintenance against the from-scratch build
+ * that would otherwise run every frame, then measures incremental insertion.
+ */
+static void bench_dynamic_bvh(int half_extent, int moves_per_frame, int frames, int ray_count) {
+    sphere_field field(half_extent, ray_count);
+    const compiled_scene& scene = field.scene;
+    const std::vector<ray>& rays = field.rays;
+
+    std::printf("dynamic bvh, half_extent %d, %zu spheres, %d moves per frame\n", half_extent, scene.spheres().size(),
+                moves_per_frame);
+
+    auto start = bench_clock::now();
+    dynamic_bvh dyn(scene);
+    double build = seconds_since(start);
+
+    std::srand(5);
+    const std::uint32_t n = static_cast<std::uint32_t>(dyn.primitive_count());
+    double refit_time = 0, maintain_time = 0;
+    int updates[3] = {0, 0, 0};
+    for (int frame = 0; frame < frames; frame++) {
+        for (int k = 0; k < moves_per_frame; k++) {
+            std::uint32_t id = static_cast<std::uint32_t>(std::rand()) % n;
+            if (dyn.sphere_radius(id) > 10) continue;  // Leave the ground in place
+            point3 c = dyn.sphere_center(id);
+            dyn.update_sphere(id, c + vec3(random_double(-0.5, 0.5), 0, random_double(-0.5, 0.5)), dyn.sphere_radius(id));
+        }
+        start = bench_clock::now();
+        dyn.refit();
+        refit_time += seconds_since(start);
+        start = bench_clock::now();
+        updates[static_cast<int>(dyn.maintain())]++;
+        maintain_time += seconds_since(start);
+    }
+    std::printf("  full build %.4f s, per frame: refit %.5f s, maintain %.5f s (%d none, %d partial, %d full)\n", build,
+                refit_time / frames, maintain_time / frames, updates[0], updates[1], updates[2]);
+    std::printf("  degradation after %d frames: %.3f\n", frames, dyn.degradation());
+    report_accel("refit", dyn, rays);
+
+    auto mat = field.arena.make<lambertian>(color(0.5, 0.5, 0.5));
+    const int inserts = 1000;
+    start = bench_clock::now();
+    for (int k = 0; k < inserts; k++) {
+        dyn.insert(point3(random_double(-half_extent, half_extent), 0.2, random_double(-half_extent, half_extent)), 0.2,
+                   mat);
+    }
+    std::printf("  %d inserts %.4f s, degradation %.3f\n", inserts, seconds_since(start), dyn.degradation());
+    report_accel("insert", dyn, rays);
+}
+
+// Inserts along a line all descend one path; the tree must stay within traversal's stack for rays along that line.
+static void bench_collinear_inserts(int chain_length) {
+    scene_arena arena;
+    auto mat = arena.make<lambertian>(color(0.5, 0.5, 0.5));
+    hittable_list line;
+    line.add(arena.make<sphere>(point3(0, 0, 0), 0.4, mat));
+    compiled_scene scene(line);
+    dynamic_bvh chain(scene);
+
+    auto start = bench_clock::now();
+    for (int k = 1; k < chain_length; k++) chain.insert(point3(k, 0, 0), 0.4, mat);
+    const double insert_time = seconds_since(start);
+
+    const ray forward(point3(-5, 0, 0), vec3(1, 0, 0)), backward(point3(chain_length + 500, 0, 0), vec3(-1, 0, 0));
+    hit_record rec;
+    const bool first = chain.hit(forward, interval(0.001, infinity), rec) && std::fabs(rec.t - 4.6) < 1e-9;
+    const bool last = chain.hit(backward, interval(0.001, infinity), rec) && std::fabs(rec.t - 500.6) < 1e-9;
+    const bool blocked = chain.occluded(forward, interval(0.001, infinity));
+    std::printf("collinear inserts, %d spheres\n", chain_length);
+    std::printf("  inserts %.4f s, %zu nodes, hits along the line %s\n", insert_time, chain.node_count(),
+                first && last && blocked ? "ok" : "WRONG");
+}
+
+// Cold build plus cache write versus mapping the cache on a later run; both must trace identically.
+static void bench_bvh_cache(int half_extent, int ray_count) {
+    sphere_field field(half_extent, ray_count);
+    const compiled_scene& scene = field.scene;
+    const std::vector<ray>& rays = field.rays;
+    const std::string path = (std::filesystem::temp_directory_path() / "rt_bench.bvhcache").string();
+    std::filesystem::remove(path);
+
+    std::printf("bvh cache, half_extent %d, %zu spheres\n", half_extent, scene.spheres().size());
+
+    auto start = bench_clock::now();
+    std::uint64_t hash = scene_content_hash(scene);
+    double hash_time = seconds_since(start);
+
+    start = bench_clock::now();
+    qbvh built(scene);
+    double build_time = seconds_since(start);
+    start = bench_clock::now();
+    bool written = write_bvh_cache(path, built, hash, scene.materials().size());
+    double write_time = seconds_since(start);
+
+    start = bench_clock::now();
+    mapped_wide_bvh<4> mapped(path, scene, hash);
+    double map_time = seconds_since(start);
+
+    std::printf("  hash %.4f s, build %.4f s, write %.4f s (%s, %ju B), map %.6f s (%s)\n", hash_time, build_time,
+                write_time, written ? "ok" : "failed", static_cast<std::uintmax_t>(std::filesystem::file_size(path)),
+                map_time, mapped.valid() ? "valid" : "invalid");
+
+    double seconds;
+    int hits = trace_rays(built, rays, seconds);
+    std::printf("  built  %6.2f Mrays/s  (hits %d)\n", rays.size() / seconds * 1e-6, hits);
+    hits = trace_rays(mapped, rays, seconds);
+    std::printf("  mapped %6.2f Mrays/s  (hits %d, first trace includes page faults)\n", rays.size() / seconds * 1e-6,
+                hits);
+
+    mapped_wide_bvh<4> stale(path, scene, hash + 1);
+    std::printf("  cache with another scene hash: %s\n", stale.valid() ? "accepted" : "rejected");
+    std::filesystem::remove(path);
+}
+
+/*
+ * Shadow rays: from each primary hit toward a point light, bounded by the light distance. Compares a closest-hit query
+ * with the any-hit occluded() query, which may stop at the first blocker and builds no hit record.
+ */
+static void bench_shadow_rays(int half_extent, int ray_count) {
+    sphere_field field(half_extent, ray_count);
+    const compiled_scene& scene = field.scene;
+    const std::vector<ray>& rays = field.rays;
+    const point3 light(0, 50, 0);
+
+    std::printf("shadow rays, half_extent %d, %zu spheres\n", half_extent, scene.spheres().size());
+
+    auto report = [&](const char* name, const hittable& accel) {
+        // Directions are left unnormalized, so the light sits at t = 1.
+        std::vector<ray> shadow_rays;
+        hit_record rec;
+        for (const auto& r : rays) {
+            if (!accel.hit(r, interval(0.001, infinity), rec)) continue;
+            shadow_rays.emplace_back(rec.p, light - rec.p);
+        }
+
+        int blocked_hit = 0, blocked_any = 0;
+        auto start = bench_clock::now();
+        for (const auto& r : shadow_rays) {
+            if (accel.hit(r, interval(0.001, 1.0), rec)) blocked_hit++;
+        }
+        double hit_time = seconds_since(start);
+        start = bench_clock::now();
+        for (const auto& r : shadow_rays) {
+            if (accel.occluded(r, interval(0.001, 1.0))) blocked_any++;
+        }
+        double any_time = seconds_since(start);
+
+        std::printf("  %-5s hit %7.2f Mrays/s  occluded %7.2f Mrays/s  (%.2fx, %zu rays, blocked %d/%d)\n", name,
+                    shadow_rays.size() / hit_time * 1e-6, shadow_rays.size() / any_time * 1e-6, hit_time / any_time,
+                    shadow_rays.size(), blocked_hit, blocked_any);
+    };
+    report("bvh2", bvh(scene));
+    report("bvh4", qbvh(scene));
+    report("grid", uniform_grid(scene));
+}
+
+/*
+ * Batch ray casting as an external caller would use it: SoA ray arrays in, distances, ids and normals out. Compared
+ * with looping hittable::hit over the object list (what a caller gets without an accelerator) and over a wide BVH.
+ * The list loop is timed on a prefix of the rays and reported as a rate.
+ */
+static void bench_ray_batch(int half_extent, int ray_count, int list_rays) {
+    sphere_field field(half_extent, ray_count);
+    const compiled_scene& scene = field.scene;
+    const std::vector<ray>& rays = field.rays;
+
+    std::printf("ray batch, half_extent %d, %zu spheres, %d threads\n", half_extent, scene.spheres().size(),
+                worker_count());
+
+    const std::size_t n = rays.size();
+    std::vector<double> ox(n), oy(n), oz(n), dx(n), dy(n), dz(n), tmin(n, 0.001), tmax(n, infinity);
+    for (std::size_t i = 0; i < n; i++) {
+        ox[i] = rays[i].origin().x();
+        oy[i] = rays[i].origin().y();
+        oz[i] = rays[i].origin().z();
+        dx[i] = rays[i].direction().x();
+        dy[i] = rays[i].direction().y();
+        dz[i] = rays[i].direction().z();
+    }
+    ray_batch batch{ox.data(), oy.data(), oz.data(), dx.data(), dy.data(), dz.data(), tmin.data(), tmax.data(), n};
+    std::vector<double> t(n), nx(n), ny(n), nz(n);
+    std::vector<std::uint32_t> ids(n);
+    std::vector<std::uint8_t> blocked(n);
+
+    auto start = bench_clock::now();
+    ray_batch_caster<4> caster(scene);
+    double build_time = seconds_since(start);
+
+    caster.intersect(batch, hit_batch{t.data(), ids.data()});  // Warm-up
+    start = bench_clock::now();
+    caster.intersect(batch, hit_batch{t.data(), ids.data(), nx.data(), ny.data(), nz.data()});
+    double batch_time = seconds_since(start);
+    int batch_hits = 0;
+    for (auto id : ids) batch_hits += id != ray_batch_miss;
+
+    start = bench_clock::now();
+    caster.occluded(batch, blocked.data());
+    double occluded_time = seconds_since(start);
+
+    std::vector<ray> list_subset(rays.begin(), rays.begin() + std::min<std::size_t>(list_rays, n));
+    double list_time, bvh_time;
+    trace_rays(field.world, list_subset, list_time);
+    int bvh_hits = trace_rays(qbvh(scene), rays, bvh_time);
+
+    const double list_rate = list_subset.size() / list_time;
+    std::printf("  build %.4f s\n", build_time);
+    std::printf("  list hit loop   %9.4f Mrays/s\n", list_rate * 1e-6);
+    std::printf("  bvh4 hit loop   %9.4f Mrays/s  (hits %d)\n", n / bvh_time * 1e-6, bvh_hits);
+    std::printf("  batch intersect %9.4f Mrays/s  (hits %d, %.0fx list)\n", n / batch_time * 1e-6, batch_hits,
+                n / batch_time / list_rate);
+    std::printf("  batch occluded  %9.4f Mrays/s\n", n / occluded_time * 1e-6);
+}
+
+// Render-like test tile: HDR colors with mostly similar channels, tile_size apart per row.
+static std::vector<color> make_hdr_tile(int edge) {
+    std::vector<color> pixels(static_cast<std::size_t>(edge) * edge);
+    for (auto& p : pixels) {
+        double luminance = 4 * random_double() * random_double() * random_double();
+        p = luminance * color(0.5 + random_double(), 0.5 + random_double(), 0.5 + random_double());
+    }
+    return pixels;
+}
+
+template <typename Format>
+static void report_pixel_format(int width, int height, const std::vector<color>& tile) {
+    memory_framebuffer<Format> fb(width, height);
+    std::vector<color> row(width);
+
+    auto start = bench_clock::now();
+    for (int t = 0; t < fb.tile_count(); t++) fb.store_tile(t, tile.data());
+    double store_time = seconds_since(start);
+    start = bench_clock::now();
+    double checksum = 0;
+    for (int y = 0; y < fb.height(); y++) {
+        fb.read_row(y, row.data());
+        checksum += row[y % width].x();
+    }
+    double read_time = seconds_since(start);
+
+    double max_error = 0;
+    for (int y = 0; y < fb.tile_size(); y++) {
+        fb.read_row(y, row.data());
+        for (int x = 0; x < fb.tile_size(); x++) {
+            const color& want = tile[static_cast<std::size_t>(y) * fb.tile_size() + x];
+            for (int c = 0; c < 3; c++) {
+                max_error = std::max(max_error, std::fabs(row[x][c] - want[c]) / std::max(want[c], 1e-3));
+            }
+        }
+    }
+
+    const double pixels = static_cast<double>(fb.pixel_count());
+    const double reference_bytes = pixels * sizeof(color);
+    std::printf("  %-7s %2zu B/px  %8.1f MB (%4.1f%% of rgb64)  store %7.1f Mpx/s  read %7.1f Mpx/s"
+                "  %6.2f GB/s stored  max rel err %.1e%s\n",
+                Format::name, fb.pixel_bytes(), fb.storage_bytes() / 1e6, 100.0 * fb.storage_bytes() / reference_bytes,
+                pixels / store_time * 1e-6, pixels / read_time * 1e-6, pixels * fb.pixel_bytes() / read_time * 1e-9,
+                max_error, checksum < 0 ? "!" : "");
+}
+
+static void bench_pixel_formats(int width, int height) {
+    std::srand(1);
+    std::printf("pixel formats, %dx%d, tiles of 32\n", width, height);
+    const std::vector<color> tile = make_hdr_tile(32);
+    report_pixel_format<rgb64_format>(width, height, tile);
+    report_pixel_format<rgb32f_format>(width, height, tile);
+    report_pixel_format<rgb16f_format>(width, height, tile);
+    report_pixel_format<rgb9e5_format>(width, height, tile);
+}
+
+/*
+ * Accumulating many low-sample passes: the float accumulator against a double reference, and against plain float
+ * sums without the per-tile correction.
+ */
+static void bench_accumulation(int width, int height, int passes) {
+    scoped_sample_rng rng(1);
+    accumulation_buffer acc(width, height);
+    const int edge = acc.tile_size();
+    const std::size_t tile_pixels = acc.tile_pixels();
+    std::vector<color> pass(tile_pixels), resolved(tile_pixels);
+    std::vector<color> reference(static_cast<std::size_t>(acc.tile_count()) * tile_pixels);
+    std::vector<float> plain(reference.size() * 3);
+
+    // Each pass adds one noisy sample around a fixed per-pixel radiance.
+    const std::vector<color> radiance = make_hdr_tile(edge);
+    double add_time = 0;
+    for (int p = 0; p < passes; p++) {
+        for (int t = 0; t < acc.tile_count(); t++) {
+            for (std::size_t i = 0; i < tile_pixels; i++) pass[i] = radiance[i] * (0.5 + random_double());
+            auto start = bench_clock::now();
+            acc.add_tile(t, pass.data(), 1);
+            add_time += seconds_since(start);
+            for (std::size_t i = 0; i < tile_pixels; i++) {
+                reference[t * tile_pixels + i] += pass[i];
+                for (int c = 0; c < 3; c++) plain[(t * tile_pixels + i) * 3 + c] += static_cast<float>(pass[i][c]);
+            }
+        }
+    }
+
+    double corrected_bias[3] = {0, 0, 0}, plain_bias[3] = {0, 0, 0}, corrected_error = 0, plain_error = 0;
+    double reference_total[3] = {0, 0, 0};
+    for (int t = 0; t < acc.tile_count(); t++) {
+        acc.resolve_tile(t, resolved.data());
+        for (int j = 0; j < acc.tile_height(t); j++) {
+            for (int i = 0; i < acc.tile_width(t); i++) {
+                const std::size_t k = static_cast<std::size_t>(j) * edge + i;
+                const color want = reference[t * tile_pixels + k] / passes;
+                for (int c = 0; c < 3; c++) {
+                    const double plain_mean = plain[(t * tile_pixels + k) * 3 + c] / static_cast<double>(passes);
+                    corrected_bias[c] += resolved[k][c] - want[c];
+                    plain_bias[c] += plain_mean - want[c];
+                    reference_total[c] += want[c];
+                    corrected_error = std::max(corrected_error, std::fabs(resolved[k][c] - want[c]) / want[c]);
+                    plain_error = std::max(plain_error, std::fabs(plain_mean - want[c]) / want[c]);
+                }
+            }
+        }
+    }
+
+    const double pixels = static_cast<double>(acc.pixel_count());
+    const double double_bytes = pixels * (sizeof(color) + sizeof(float) + sizeof(std::uint32_t));
+    std::printf("accumulation, %dx%d, %d passes\n", width, height, passes);
+    std::printf("  double color + float variance + count: %8.1f MB\n", double_bytes / 1e6);
+    std::printf("  float sums + per-tile double totals:   %8.1f MB (%.1f%%)  add %.1f Mpx/s\n",
+                acc.storage_bytes() / 1e6, 100.0 * acc.storage_bytes() / double_bytes,
+                pixels * passes / add_time * 1e-6);
+    std::printf("  relative bias of the image mean (r g b): plain float %.1e %.1e %.1e, corrected %.1e %.1e %.1e\n",
+                plain_bias[0] / reference_total[0], plain_bias[1] / reference_total[1],
+                plain_bias[2] / reference_total[2], corrected_bias[0] / reference_total[0],
+                corrected_bias[1] / reference_total[1], corrected_bias[2] / reference_total[2]);
+    std::printf("  max per-pixel relative error: plain float %.1e, corrected %.1e\n", plain_error, corrected_error);
+}
+
+// PNG encoding of a render-like framebuffer (smooth gradient plus sample noise) on one thread and on all of them.
+static void bench_png(int width, int height) {
+    scoped_sample_rng rng(1);
+    memory_framebuffer<> fb(width, height);
+    std::vector<color> tile(fb.tile_pixels());
+    for (int t = 0; t < fb.tile_count(); t++) {
+        for (int j = 0; j < fb.tile_height(t); j++) {
+            for (int i = 0; i < fb.tile_width(t); i++) {
+                const double v = static_cast<double>(fb.tile_y0(t) + j) / height;
+                const double noise = 0.05 * (random_double() - 0.5);
+                tile[static_cast<std::size_t>(j) * fb.tile_size() + i] =
+                    color(0.5 + 0.5 * v + noise, 0.7 + 0.3 * v + noise, 1.0) * (0.2 + 0.8 * (fb.tile_x0(t) + i) / width);
+            }
+        }
+        fb.store_tile(t, tile.data());
+    }
+
+    std::ostringstream ppm;
+    auto start = bench_clock::now();
+    write_ppm(ppm, fb);
+    double ppm_time = seconds_since(start);
+
+    std::printf("png, %dx%d, ppm %.1f MB in %.3f s\n", width, height, ppm.str().size() / 1e6, ppm_time);
+    for (unsigned threads : {1u, worker_count()}) {
+        std::ostringstream png;
+        start = bench_clock::now();
+        write_png(png, fb, threads);
+        double png_time = seconds_since(start);
+        std::printf("  %2u threads  %.3f s  %7.1f Mpx/s  %.2f MB (%.1f%% of ppm)\n", threads, png_time,
+                    fb.pixel_count() / png_time * 1e-6, png.str().size() / 1e6,
+                    100.0 * png.str().size() / ppm.str().size());
+    }
+}
+
+// Final 8-bit conversion of one image: per-pixel write_color against the row quantizer, as text and as bytes.
+static void bench_quantize(int width, int height) {
+    scoped_sample_rng rng(1);
+    std::vector<color> image(static_cast<std::size_t>(width) * height);
+    for (auto& c : image) c = color(random_double(), random_double(), random_double()) * 1.2;
+    std::vector<unsigned char> bytes(static_cast<std::size_t>(width) * 3);
+    const double pixels = static_cast<double>(image.size());
+
+    std::ostringstream per_pixel, per_row;
+    auto start = bench_clock::now();
+    for (const color& c : image) write_color(per_pixel, c);
+    double write_color_time = seconds_since(start);
+    start = bench_clock::now();
+    for (int y = 0; y < height; y++) write_ppm_row(per_row, &image[static_cast<std::size_t>(y) * width], width, y);
+    double ppm_row_time = seconds_since(start);
+
+    unsigned checksum = 0;
+    start = bench_clock::now();
+    for (int y = 0; y < height; y++) {
+        const color* row = &image[static_cast<std::size_t>(y) * width];
+        for (int i = 0; i < width; i++) {
+            for (int c = 0; c < 3; c++) bytes[3 * i + c] = quantize_channel(row[i][c]);
+        }
+        checksum += bytes[y % width];
+    }
+    double scalar_time = seconds_since(start);
+    start = bench_clock::now();
+    for (int y = 0; y < height; y++) {
+        quantize_row(&image[static_cast<std::size_t>(y) * width], width, bytes.data(), y);
+        checksum += bytes[y % width];
+    }
+    double row_time = seconds_since(start);
+    start = bench_clock::now();
+    for (int y = 0; y < height; y++) {
+        quantize_row(&image[static_cast<std::size_t>(y) * width], width, bytes.data(), y, dither_mode::ordered);
+        checksum += bytes[y % width];
+    }
+    double dither_time = seconds_since(start);
+
+    std::printf("quantize, %dx%d\n", width, height);
+    std::printf("  write_color per pixel   %8.1f Mpx/s\n", pixels / write_color_time * 1e-6);
+    std::printf("  write_ppm_row           %8.1f Mpx/s  (%.1fx, output %s)\n", pixels / ppm_row_time * 1e-6,
+                write_color_time / ppm_row_time, per_pixel.str() == per_row.str() ? "identical" : "DIFFERS");
+    std::printf("  scalar bytes            %8.1f Mpx/s\n", pixels / scalar_time * 1e-6);
+    std::printf("  quantize_row            %8.1f Mpx/s  (%.1fx scalar)\n", pixels / row_time * 1e-6,
+                scalar_time / row_time);
+    std::printf("  quantize_row, dithered  %8.1f Mpx/s%s\n", pixels / dither_time * 1e-6, checksum ? "" : " ");
+}
+
+/*
+ * Checkpointing an accumulation buffer: how long the caller is held up and how long until the data is durable, for
+ * blocking write + fdatasync against the asynchronous writer on io_uring and on its fallback thread.
+ */
+static void bench_checkpoint(int width, int height, int checkpoints) {
+    accumulation_buffer acc(width, height);
+    std::vector<color> tile(acc.tile_pixels(), color(0.25, 0.5, 0.75));
+    for (int t = 0; t < acc.tile_count(); t++) acc.add_tile(t, tile.data(), 1);
+    const std::string path = (std::filesystem::temp_directory_path() / "rt_bench_checkpoint.bin").string();
+    std::printf("checkpoint, %dx%d, %.1f MB, %d checkpoints\n", width, height, acc.storage_bytes() / 1e6, checkpoints);
+
+    // Blocking baseline: the same bytes written in place by the calling thread.
+    {
+        std::filesystem::remove(path);
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        std::vector<unsigned char> snapshot(acc.storage_bytes());
+        double blocked = 0;
+        for (int c = 0; c < checkpoints; c++) {
+            auto start = bench_clock::now();
+            std::size_t done = 0;
+            while (done < snapshot.size()) {
+                const ssize_t n = ::pwrite(fd, snapshot.data() + done, snapshot.size() - done, done);
+                if (n <= 0) break;
+                done += static_cast<std::size_t>(n);
+            }
+            ::fdatasync(fd);
+            blocked += seconds_since(start);
+        }
+        ::close(fd);
+        std::printf("  blocking pwrite+fdatasync  caller blocked %8.3f ms per checkpoint (= time to durable)\n",
+                    blocked / checkpoints * 1e3);
+    }
+
+    for (bool prefer_thread : {false, true}) {
+        std::filesystem::remove(path);
+        async_writer writer(path, 64, prefer_thread);
+        double handoff = 0, durable = 0;
+        for (int c = 0; c < checkpoints; c++) {
+            auto start = bench_clock::now();
+            const async_writer::ticket t = acc.save(writer);
+            handoff += seconds_since(start);
+            writer.wait_durable(t);
+            durable += seconds_since(start);
+        }
+        std::printf("  async, %-9s           caller blocked %8.3f ms per checkpoint, durable after %8.3f ms%s\n",
+                    writer.uses_io_uring() ? "io_uring" : "thread", handoff / checkpoints * 1e3,
+                    durable / checkpoints * 1e3, writer.error() ? " (errors)" : "");
+    }
+
+    accumulation_buffer restored(width, height);
+    std::printf("  reload %s\n", restored.load(path) && restored.samples(0) == 1 ? "ok" : "FAILED");
+    std::filesystem::remove(path);
+}
+
+// Cost of publishing accumulation live: tile adds into private memory, into a shared segment, and into a shared
+// segment while a viewer thread keeps taking tile snapshots.
+static void bench_live_framebuffer(int width, int height, int passes) {
+    std::vector<color> tile(32 * 32);
+    for (std::size_t i = 0; i < tile.size(); i++) tile[i] = color(0.25, 0.5, 0.75) * (0.5 + (i % 7) / 7.0);
+    auto add_passes = [&](accumulation_buffer& acc) {
+        auto start = bench_clock::now();
+        for (int p = 0; p < passes; p++) {
+            for (int t = 0; t < acc.tile_count(); t++) acc.add_tile(t, tile.data(), 1);
+        }
+        return static_cast<double>(acc.pixel_count()) * passes / seconds_since(start) * 1e-6;
+    };
+
+    std::printf("live framebuffer, %dx%d, %d passes\n", width, height, passes);
+    {
+        accumulation_buffer acc(width, height);
+        std::printf("  private accumulation          add %8.1f Mpx/s\n", add_passes(acc));
+    }
+    {
+        shared_accumulation_buffer acc("/rt_bench_live", width, height);
+        const double rate = add_passes(acc);
+        std::printf("  shared segment (%6.1f MB)    add %8.1f Mpx/s%s\n", acc.segment_bytes() / 1e6, rate,
+                    acc.valid() ? "" : " (no segment)");
+    }
+    {
+        shared_accumulation_buffer acc("/rt_bench_live", width, height);
+        live_framebuffer_view view("/rt_bench_live");
+        std::atomic<bool> done{false};
+        std::uint64_t snapshots = 0, last_generation = 0;
+        std::thread viewer([&] {
+            std::vector<color> pixels(view.tile_pixels());
+            while (view.valid() && !done.load()) {
+                for (int t = 0; t < view.tile_count() && !done.load(); t++, snapshots++) {
+                    view.resolve_tile(t, pixels.data());
+                }
+                last_generation = view.generation();
+            }
+        });
+        const double rate = add_passes(acc);
+        done = true;
+        viewer.join();
+        std::printf("  shared segment + viewer       add %8.1f Mpx/s, viewer took %llu tile snapshots, saw generation "
+                    "%llu\n",
+                    rate, static_cast<unsigned long long>(snapshots), static_cast<unsigned long long>(last_generation));
+    }
+}
+
+int main() {
+    bench_scene_construction(11, 20000);
+    bench_scene_construction(100, 200);
+    bench_compiled_scene(11, 20000);
+    bench_compiled_scene(100, 200);
+    bench_material_interning(11);
+    bench_material_interning(300);
+    bench_bvh_build("lbvh", bvh_builder::lbvh, 11, 200000);
+    bench_bvh_build("lbvh", bvh_builder::lbvh, 500, 200000);
+    bench_bvh_build("binned_sah", bvh_builder::binned_sah, 11, 200000, 16);
+    bench_bvh_build("binned_sah", bvh_builder::binned_sah, 11, 200000, 64);
+    bench_bvh_build("binned_sah", bvh_builder::binned_sah, 500, 200000, 16);
+    bench_bvh_build("binned_sah", bvh_builder::binned_sah, 500, 200000, 32);
+    bench_wide_bvh(11, 200000);
+    bench_wide_bvh(500, 200000);
+    bench_compressed_bvh(11, 200000);
+    bench_compressed_bvh(500, 200000);
+    bench_uniform_grid(11, 200000);
+    bench_uniform_grid(500, 200000);
+    bench_instancing(256, 64, 200000);
+    bench_dynamic_bvh(11, 8, 100, 200000);
+    bench_dynamic_bvh(300, 64, 20, 200000);
+    bench_collinear_inserts(2000);
+    bench_bvh_cache(11, 200000);
+    bench_bvh_cache(500, 200000);
+    bench_shadow_rays(11, 200000);
+    bench_shadow_rays(500, 200000);
+    bench_ray_batch(11, 200000, 20000);
+    bench_ray_batch(500, 200000, 20);
+    bench_pixel_formats(4096, 4096);
+    bench_accumulation(128, 128, 65536);
+    bench_png(1920, 1080);
+    bench_quantize(1920, 1080);
+    bench_checkpoint(1920, 1080, 10);
+    bench_live_framebuffer(1920, 1080, 20);
+}
@@ -4,69 +4,127 @@
 
 #include "rtweekend.h"
 
+#include "arena.h"
+#include "bvh_cache.h"
 #include "camera.h"
+#include "compiled_scene.h"
+#include "framebuffer.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "image_writer.h"
+#include "live_framebuffer.h"
 #include "material.h"
+#include "material_registry.h"
+#include "scene_file.h"
+#include "scenes.h"
 #include "sphere.h"
+#include "wide_bvh.h"
+
+// Mapped framebuffer sized for the camera's image, or null if the file cannot be created.
+template <typename Format>
+static std::unique_ptr<framebuffer> open_framebuffer(const char* path, const camera& cam) {
+    auto fb = std::make_unique<mapped_framebuffer<Format>>(path, cam.image_width, cam.output_height(), cam.tile_size);
+    if (!fb->valid()) return nullptr;
+    return fb;
+}
 
 int main() {
+    // The arena owns every sphere and material; it must outlive the world that points into it.
+    scene_arena arena;
+    material_registry<scene_arena> materials(arena);
     hittable_list world;
+    camera cam;
 
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, ground_material));
-
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
-
-            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphere_material;
-
-                if (choose_mat < 0.8) {
-                    // diffuse
-                    auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                } else if (choose_mat < 0.95) {
-                    // metal
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                } else {
-                    // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
-                }
-            }
+    // With RT_SCENE set to a binary scene file (see scene_convert), spheres, materials and camera settings are mapped
+    // from it instead of building the cover scene in code. Either way the scene is flattened into SoA arrays once.
+    std::unique_ptr<compiled_scene> scene;
+    if (const char* scene_path = std::getenv("RT_SCENE")) {
+        mapped_scene file(scene_path);
+        if (!file.valid()) {
+            std::cerr << "Cannot load scene file " << scene_path << '\n';
+            return 1;
         }
+        scene = std::make_unique<compiled_scene>(file.compile());
+        file.camera_settings().apply(cam);
+    } else {
+        // Identical material parameter sets (e.g. every dielectric(1.5)) share one interned object.
+        random_spheres_scene(world, materials);
+        random_spheres_camera(cam);
+        scene = std::make_unique<compiled_scene>(world);
     }
 
-    auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
-
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
-
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    // Build the hierarchy rendering traverses. With RT_BVH_CACHE set to a file path, the hierarchy is mapped from that
+    // cache when it matches the scene and written there otherwise.
+    const char* cache_path = std::getenv("RT_BVH_CACHE");
+    shared_ptr<hittable> accel = cache_path ? load_or_build_wide_bvh<4>(*scene, cache_path) : make_shared<qbvh>(*scene);
 
-    camera cam;
+    // RT_IMAGE_FORMAT selects the output: "ppm" (the default) or "png", both 8-bit, or "pfm" and "hdr", which keep
+    // linear float radiance for later tone mapping.
+    const char* image_format = std::getenv("RT_IMAGE_FORMAT");
+    const std::string image_format_name = image_format ? image_format : "ppm";
+    if (image_format_name != "ppm" && image_format_name != "png" && image_format_name != "pfm" &&
+        image_format_name != "hdr") {
+        std::cerr << "Unknown image format " << image_format_name << '\n';
+        return 1;
+    }
+    // Any non-empty RT_DITHER other than "0" turns on ordered dithering of 8-bit output.
+    const char* dither = std::getenv("RT_DITHER");
+    if (dither && *dither && std::string(dither) != "0") cam.dither = dither_mode::ordered;
 
-    cam.aspect_ratio      = 16.0 / 9.0;
-    cam.image_width       = 1200;
-    cam.samples_per_pixel = 500;
-    cam.max_depth         = 50;
+    // With RT_FRAMEBUFFER set to a file path, the image is rendered into a tiled framebuffer mapped from that file and
+    // written out once complete; only active tiles stay resident, so images larger than memory still render.
+    // RT_FRAMEBUFFER_FORMAT picks a packed pixel format (rgb32f, rgb16f or rgb9e5) to shrink the file.
+    std::unique_ptr<framebuffer> fb;
+    if (const char* framebuffer_path = std::getenv("RT_FRAMEBUFFER")) {
+        const char* format = std::getenv("RT_FRAMEBUFFER_FORMAT");
+        const std::string format_name = format ? format : rgb64_format::name;
+        if (format_name == rgb64_format::name) {
+            fb = open_framebuffer<rgb64_format>(framebuffer_path, cam);
+        } else if (format_name == rgb32f_format::name) {
+            fb = open_framebuffer<rgb32f_format>(framebuffer_path, cam);
+        } else if (format_name == rgb16f_format::name) {
+            fb = open_framebuffer<rgb16f_format>(framebuffer_path, cam);
+        } else if (format_name == rgb9e5_format::name) {
+            fb = open_framebuffer<rgb9e5_format>(framebuffer_path, cam);
+        } else {
+            std::cerr << "Unknown framebuffer format " << format_name << '\n';
+            return 1;
+        }
+        if (!fb) {
+            std::cerr << "Cannot create framebuffer file " << framebuffer_path << '\n';
+            return 1;
+        }
+    } else if (image_format_name == "png") {
+        // PNG strips are compressed in parallel after rendering, from the same colors the PPM stream would print.
+        fb = std::make_unique<memory_framebuffer<>>(cam.image_width, cam.output_height(), cam.tile_size);
+    } else if (image_format_name != "ppm") {
+        // Float formats need the whole image (PFM is stored bottom row first), so render into float tiles.
+        fb = std::make_unique<memory_framebuffer<rgb32f_format>>(cam.image_width, cam.output_height(), cam.tile_size);
+    }
 
-    cam.vfov     = 20;
-    cam.lookfrom = point3(13,2,3);
-    cam.lookat   = point3(0,0,0);
-    cam.vup      = vec3(0,1,0);
+    // With RT_LIVE_FRAMEBUFFER set to a shared-memory name (e.g. /rt_live), the image is rendered progressively, one
+    // sample per pixel per pass, into an accumulation buffer in that segment. Preview tools map it read-only with
+    // live_framebuffer_view and redraw whenever its generation changes; the final image is resolved from it.
+    if (const char* live_name = std::getenv("RT_LIVE_FRAMEBUFFER")) {
+        shared_accumulation_buffer live(live_name, cam.image_width, cam.output_height(), cam.tile_size);
+        if (!live.valid()) {
+            std::cerr << "Cannot create shared memory segment " << live_name << '\n';
+            return 1;
+        }
+        if (!fb) fb = std::make_unique<memory_framebuffer<>>(cam.image_width, cam.output_height(), cam.tile_size);
+        const int passes = cam.samples_per_pixel;
+        cam.samples_per_pixel = 1;
+        cam.accumulate(*accel, live, 0, passes);
+        live.resolve(*fb);
+        write_image(std::cout, *fb, image_format_name, cam.threads, cam.dither);
+        return 0;
+    }
 
-    cam.defocus_angle = 0.6;
-    cam.focus_dist    = 10.0;
+    if (fb) {
+        cam.render(*accel, *fb);
+        write_image(std::cout, *fb, image_format_name, cam.threads, cam.dither);
+        return 0;
+    }
 
-    cam.render(world);
+    cam.render(*accel);
 }
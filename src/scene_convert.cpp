@@ -0,0 +1,62 @@
+/*
+ * scene converter: text scene descriptions (or the built-in cover scene) to mapped binary scene files
+ */
+
+#include "rtweekend.h"
+
+#include "arena.h"
+#include "camera.h"
+#include "hittable_list.h"
+#include "material_registry.h"
+#include "scene_file.h"
+#include "scenes.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+static int usage() {
+    std::fprintf(stderr,
+                 "usage: scene_convert <scene.txt> <scene.rtscene>\n"
+                 "       scene_convert --random <half_extent> <scene.rtscene>\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    scene_description scene;
+
+    if (argc == 4 && std::strcmp(argv[1], "--random") == 0) {
+        // Same builders as the renderer, so the file matches the built-in scene sphere for sphere.
+        scene_arena arena;
+        material_registry<scene_arena> registry(arena);
+        scene_recorder<material_registry<scene_arena>> recorder(registry, scene);
+        hittable_list world;
+        random_spheres_scene(world, recorder, std::atoi(argv[2]));
+
+        camera cam;
+        random_spheres_camera(cam);
+        scene.camera_settings = scene_camera_record::from(cam);
+    } else if (argc == 3) {
+        std::ifstream in(argv[1]);
+        if (!in) {
+            std::fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 1;
+        }
+        std::string error;
+        if (!parse_scene_text(in, scene, error)) {
+            std::fprintf(stderr, "%s: %s\n", argv[1], error.c_str());
+            return 1;
+        }
+    } else {
+        return usage();
+    }
+
+    const char* out_path = argv[argc - 1];
+    if (!write_scene_file(out_path, scene)) {
+        std::fprintf(stderr, "cannot write %s\n", out_path);
+        return 1;
+    }
+    std::printf("%s: %zu spheres, %zu materials\n", out_path, scene.spheres.size(), scene.materials.size());
+    return 0;
+}